@@ -0,0 +1,107 @@
+#include "template.h"
+
+bool AnimatedModel::AddFrame( const char* file )
+{
+	VoxelModel frame;
+	if (!frame.Load( file )) return false;
+	AddFrame( frame );
+	return true;
+}
+
+void AnimatedModel::Diff( const vector<uint>& from, const vector<uint>& to, vector<Patch>& patches )
+{
+	patches.clear();
+	for (uint i = 0; i < (uint)to.size(); i++) if (from[i] != to[i]) patches.push_back( { i, to[i] } );
+}
+
+void AnimatedModel::AddFrame( const VoxelModel& frame )
+{
+	// the first frame sets the size; later frames must have the same size
+	if (delta.empty())
+	{
+		size = frame.size;
+		bricks = make_int3( (size.x + BRICKDIM - 1) / BRICKDIM, (size.y + BRICKDIM - 1) / BRICKDIM, (size.z + BRICKDIM - 1) / BRICKDIM );
+	}
+	else if (frame.size.x != size.x || frame.size.y != size.y || frame.size.z != size.z) FatalError( "Animation frames differ in size" );
+	// split the frame in bricks; bricks at the far sides are padded with empty voxels
+	vector<uint> table( Slots() );
+	ALIGN( 64 ) uint voxels[BRICKSIZE];
+	for (int bz = 0; bz < bricks.z; bz++) for (int by = 0; by < bricks.y; by++) for (int bx = 0; bx < bricks.x; bx++)
+	{
+		memset( voxels, 0, sizeof( voxels ) );
+		const int3 b = make_int3( bx, by, bz ) * BRICKDIM, e = min( b + BRICKDIM, size ) - b;
+		for (int z = 0; z < e.z; z++) for (int y = 0; y < e.y; y++)
+			memcpy( voxels + y * BRICKDIM + z * BRICKDIM * BRICKDIM, frame.voxels + b.x + (b.y + y) * size.x + (size_t)(b.z + z) * size.x * size.y, e.x * sizeof( uint ) );
+		table[bx + by * bricks.x + bz * bricks.x * bricks.y] = store.Add( voxels );
+	}
+	// the previous last frame now leads to this one; this one leads back to frame 0
+	if (delta.empty()) keyframe = table, delta.resize( 1 );
+	else
+	{
+		Diff( last, table, delta.back() );
+		delta.push_back( {} );
+		Diff( table, keyframe, delta.back() );
+	}
+	last.swap( table );
+}
+
+void AnimatedModel::Seek( uint* table, const uint frame ) const
+{
+	// the keyframe, patched up to the requested frame
+	memcpy( table, keyframe.data(), Slots() * sizeof( uint ) );
+	for (uint i = 0; i < frame % Frames(); i++) for (const Patch& patch : delta[i]) table[patch.slot] = patch.brick;
+}
+
+void AnimatedModel::Next( uint* table, const uint frame ) const
+{
+	// turn the table of 'frame' into that of the frame after it
+	for (const Patch& patch : delta[frame % Frames()]) table[patch.slot] = patch.brick;
+}
+
+size_t AnimatedModel::MemoryUsed() const
+{
+	size_t bytes = store.MemoryUsed() + keyframe.size() * sizeof( uint );
+	for (const vector<Patch>& patches : delta) bytes += patches.size() * sizeof( Patch );
+	return bytes;
+}
+
+bool AnimatedModel::FindNearest( const uint* table, const float3& O, const float3& D, float& t, uint& voxel, uint& axis ) const
+{
+	// as VoxelModel::FindNearest at level 0; voxels are read through the brick table
+	const float3 rD( 1 / (D.x != 0 ? D.x : 1e-20f), 1 / (D.y != 0 ? D.y : 1e-20f), 1 / (D.z != 0 ? D.z : 1e-20f) );
+	const float3 t1 = -O * rD, t2 = (float3( size ) - O) * rD, tnear = fminf( t1, t2 ), tfar = fmaxf( t1, t2 );
+	const float tmin = max( max( tnear.x, tnear.y ), tnear.z ), tmax = min( min( tfar.x, tfar.y ), tfar.z );
+	if (tmax < tmin || tmax <= 0 || tmin >= t) return false;
+	uint a = tmin == tnear.x ? 0 : tmin == tnear.y ? 1 : 2;
+	float tc = max( tmin, 0.0f );
+	const float3 P = O + tc * D;
+	int3 cell = clamp( make_int3( (int)floorf( P.x ), (int)floorf( P.y ), (int)floorf( P.z ) ), make_int3( 0 ), size - 1 );
+	const int3 step = make_int3( D.x < 0 ? -1 : 1, D.y < 0 ? -1 : 1, D.z < 0 ? -1 : 1 );
+	const float3 tdelta = fabs( rD );
+	float3 tnext( (cell.x + (step.x > 0) - O.x) * rD.x, (cell.y + (step.y > 0) - O.y) * rD.y, (cell.z + (step.z > 0) - O.z) * rD.z );
+	// a ray that starts in a solid voxel leaves it first
+	bool skip = tmin <= 0;
+	while (tc < t)
+	{
+		const uint id = table[cell.x / BRICKDIM + (cell.y / BRICKDIM) * bricks.x + (cell.z / BRICKDIM) * bricks.x * bricks.y];
+		const uint v = id ? store.Get( id )[cell.x % BRICKDIM + (cell.y % BRICKDIM) * BRICKDIM + (cell.z % BRICKDIM) * BRICKDIM * BRICKDIM] : 0;
+		if (v && !skip) { t = tc, voxel = v, axis = a; return true; }
+		skip = false;
+		if (tnext.x < tnext.y && tnext.x < tnext.z)
+		{
+			tc = tnext.x, a = 0, tnext.x += tdelta.x;
+			if ((cell.x += step.x) < 0 || cell.x >= size.x) return false;
+		}
+		else if (tnext.y < tnext.z)
+		{
+			tc = tnext.y, a = 1, tnext.y += tdelta.y;
+			if ((cell.y += step.y) < 0 || cell.y >= size.y) return false;
+		}
+		else
+		{
+			tc = tnext.z, a = 2, tnext.z += tdelta.z;
+			if ((cell.z += step.z) < 0 || cell.z >= size.z) return false;
+		}
+	}
+	return false;
+}
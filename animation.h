@@ -0,0 +1,39 @@
+#pragma once
+
+namespace Tmpl8 {
+
+// AnimatedModel: a voxel animation whose frames share bricks.
+// Each frame is split in bricks of BRICKDIM^3 voxels, which go into a
+// BrickStore, so a brick that several frames have in common is stored once.
+// A frame is a table with a brick id per brick of the model. Only the table of
+// frame 0 (the keyframe) is stored in full; delta[i] lists the table entries
+// that change from frame i to frame i + 1, and the last delta leads back to
+// frame 0, so a looping animation is played by patching a table with one
+// delta per frame. Each instance has its own table (see Instance::table); a
+// ray reads a voxel through it, so switching frames copies no voxels.
+// Seek builds the table of any frame from the keyframe.
+// Animated instances are traced at full resolution; they have no mip chain.
+class AnimatedModel
+{
+public:
+	struct Patch { uint slot, brick; };
+	bool AddFrame( const char* file );
+	void AddFrame( const VoxelModel& frame );
+	void Seek( uint* table, const uint frame ) const;
+	void Next( uint* table, const uint frame ) const;
+	bool FindNearest( const uint* table, const float3& O, const float3& D, float& t, uint& voxel, uint& axis ) const;
+	uint Frames() const { return (uint)delta.size(); }
+	uint Slots() const { return bricks.x * bricks.y * bricks.z; }
+	size_t MemoryUsed() const;
+	// data members
+	int3 size = make_int3( 0 );		// in voxels, the same for all frames
+	int3 bricks = make_int3( 0 );	// size in bricks, rounded up
+	BrickStore store;
+	vector<uint> keyframe;			// brick ids of frame 0
+	vector<vector<Patch>> delta;	// per frame: the changes to the next frame
+private:
+	static void Diff( const vector<uint>& from, const vector<uint>& to, vector<Patch>& patches );
+	vector<uint> last;				// brick ids of the last frame added
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,123 @@
+#include "template.h"
+
+Automaton::Automaton()
+{
+	queued = (uchar*)MALLOC64( BRICKCOUNT );
+	touched = (uchar*)MALLOC64( BRICKCOUNT );
+	memset( queued, 0, BRICKCOUNT );
+	memset( touched, 0, BRICKCOUNT );
+}
+
+Automaton::~Automaton()
+{
+	FREE64( queued );
+	FREE64( touched );
+}
+
+void Automaton::Activate( const uint brick )
+{
+	// simulate the brick and its neighbours in the next step
+	const int bx = brick % GRIDBRICKS, by = (brick / GRIDBRICKS) % GRIDBRICKS, bz = brick / GRIDBRICKS2;
+	for (int z = max( bz - 1, 0 ); z <= min( bz + 1, GRIDBRICKS - 1 ); z++)
+		for (int y = max( by - 1, 0 ); y <= min( by + 1, GRIDBRICKS - 1 ); y++)
+			for (int x = max( bx - 1, 0 ); x <= min( bx + 1, GRIDBRICKS - 1 ); x++)
+			{
+				const uint n = x + y * GRIDBRICKS + z * GRIDBRICKS2;
+				if (!queued[n]) queued[n] = 1, next.push_back( n );
+			}
+}
+
+uint Automaton::UpdateBrick( uint* grid, const uint brick ) const
+{
+	// returns the bricks that changed: bit (dx + 1) + (dy + 1) * 3 + (dz + 1) * 9
+	// for the brick at offset (dx, dy, dz) from this one
+	static const int3 fall[4] = { make_int3( 1, -1, 0 ), make_int3( -1, -1, 0 ), make_int3( 0, -1, 1 ), make_int3( 0, -1, -1 ) };
+	static const int3 flow[4] = { make_int3( 1, 0, 0 ), make_int3( -1, 0, 0 ), make_int3( 0, 0, 1 ), make_int3( 0, 0, -1 ) };
+	const int3 b = make_int3( brick % GRIDBRICKS, (brick / GRIDBRICKS) % GRIDBRICKS, brick / GRIDBRICKS2 ) * BRICKDIM;
+	uint changes = 0;
+	// bottom to top; the horizontal order alternates between steps against drift
+	for (int ly = 0; ly < BRICKDIM; ly++) for (int i = 0; i < BRICKDIM; i++) for (int j = 0; j < BRICKDIM; j++)
+	{
+		const int lz = step & 2 ? BRICKDIM - 1 - i : i, lx = step & 1 ? BRICKDIM - 1 - j : j;
+		const int x = b.x + lx, y = b.y + ly, z = b.z + lz;
+		const uint idx = x + y * GRIDSIZE + z * GRIDSIZE2, v = grid[idx];
+		if (!(v & (SIM_SAND | SIM_FLUID)) || (v & SIM_MOVED)) continue;
+		int3 d = make_int3( 0 );
+		bool found = false;
+		if (y > 0 && !grid[idx - GRIDSIZE]) d = make_int3( 0, -1, 0 ), found = true;
+		// blocked: try the four diagonals down, starting at a random one
+		const uint first = WangHash( idx + step * 0x9e3779b9u );
+		for (int k = 0; k < 4 && !found && y > 0; k++)
+		{
+			const int3 c = fall[(first + k) & 3], p = make_int3( x, y, z ) + c;
+			if (p.x < 0 || p.z < 0 || p.x >= GRIDSIZE || p.z >= GRIDSIZE) continue;
+			if (!grid[p.x + p.y * GRIDSIZE + p.z * GRIDSIZE2]) d = c, found = true;
+		}
+		if (!found && (v & SIM_FLUID))
+		{
+			// flow sideways toward a drop, or anywhere when fluid above presses down
+			const bool pressed = y < GRIDSIZE - 1 && (grid[idx + GRIDSIZE] & SIM_FLUID);
+			for (int k = 0; k < 4 && !found; k++)
+			{
+				const int3 c = flow[(first + k) & 3], p = make_int3( x, y, z ) + c;
+				if (p.x < 0 || p.z < 0 || p.x >= GRIDSIZE || p.z >= GRIDSIZE) continue;
+				const uint target = p.x + p.y * GRIDSIZE + p.z * GRIDSIZE2;
+				if (!grid[target] && (pressed || (y > 0 && !grid[target - GRIDSIZE]))) d = c, found = true;
+			}
+		}
+		if (!found) continue;
+		grid[idx + d.x + d.y * GRIDSIZE + d.z * GRIDSIZE2] = v | SIM_MOVED, grid[idx] = 0;
+		const int ox = lx + d.x < 0 ? 0 : lx + d.x >= BRICKDIM ? 2 : 1;
+		const int oy = ly + d.y < 0 ? 0 : 1, oz = lz + d.z < 0 ? 0 : lz + d.z >= BRICKDIM ? 2 : 1;
+		changes |= (1 << 13) | (1 << (ox + oy * 3 + oz * 9));
+	}
+	return changes;
+}
+
+void Automaton::Wake( const Scene& scene )
+{
+	// edits may have given voxels room to move, or added voxels that move
+	for (const uint brick : scene.dirtyBricks) Activate( brick );
+}
+
+void Automaton::Step( Scene& scene )
+{
+	Wake( scene );
+	active.swap( next );
+	next.clear();
+	for (const uint brick : active) queued[brick] = 0;
+	vector<uint> changes( active.size() ), pass;
+	for (int parity = 0; parity < 8; parity++)
+	{
+		pass.clear();
+		for (uint i = 0; i < active.size(); i++)
+		{
+			const uint brick = active[i];
+			const int bx = brick % GRIDBRICKS, by = (brick / GRIDBRICKS) % GRIDBRICKS, bz = brick / GRIDBRICKS2;
+			if ((bx & 1) + (by & 1) * 2 + (bz & 1) * 4 == parity) pass.push_back( i );
+		}
+	#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)pass.size(); i++) changes[pass[i]] = UpdateBrick( scene.grid, active[pass[i]] );
+	}
+	// gather the changed bricks; moves stay within the world, so their neighbours exist
+	changed.clear();
+	for (uint i = 0; i < active.size(); i++) for (uint bits = changes[i]; bits; bits &= bits - 1)
+	{
+		const int n = (int)_mm_popcnt_u32( (bits & (0 - bits)) - 1 );
+		const uint brick = active[i] + (n % 3 - 1) + ((n / 3) % 3 - 1) * GRIDBRICKS + (n / 9 - 1) * GRIDBRICKS2;
+		if (!touched[brick]) touched[brick] = 1, changed.push_back( brick );
+	}
+	for (const uint brick : changed)
+	{
+		const int x = (brick % GRIDBRICKS) * BRICKDIM, y = ((brick / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM, z = (brick / GRIDBRICKS2) * BRICKDIM;
+		for (int i = 0; i < BRICKDIM * BRICKDIM; i++)
+		{
+			uint* v = scene.grid + x + (y + i % BRICKDIM) * GRIDSIZE + (z + i / BRICKDIM) * GRIDSIZE2;
+			for (int j = 0; j < BRICKDIM; j++) v[j] &= ~SIM_MOVED;
+		}
+		touched[brick] = 0;
+		scene.MarkDirty( brick );
+		Activate( brick );
+	}
+	step++;
+}
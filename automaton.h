@@ -0,0 +1,42 @@
+#pragma once
+
+#define SIMRATE		60		// automaton steps per second
+#define SIMSTEPS	4		// at most this many steps per frame
+
+namespace Tmpl8 {
+
+// Automaton: falling sand and fluid simulation on the scene grid.
+// Voxels with the SIM_SAND flag fall, and slide down diagonally when blocked.
+// SIM_FLUID voxels also flow sideways, toward a drop or when pressed down by
+// fluid above them, so that pools level out and then come to rest. A voxel
+// moves at most one voxel per step.
+// Only active bricks are simulated: bricks that changed in the last step or
+// were edited since then, and their neighbours; a world at rest costs nothing.
+// Edits are seen through the dirty bricks of the scene, so Wake must be called
+// before each Scene::ClearDirty, also while the automaton is not stepped;
+// otherwise voxels that were placed meanwhile stay where they are.
+// Active bricks are updated in parallel, in eight passes: one per parity of
+// the brick coordinates. Bricks with the same parity are a brick apart, and a
+// voxel never looks further than one voxel out of its brick, so no two
+// threads touch the same voxel. A voxel that moved carries SIM_MOVED until the
+// end of the step, so it does not move again if its new brick comes later.
+// Changed bricks are marked dirty, for the mip volume and the light tree.
+class Automaton
+{
+public:
+	Automaton();
+	~Automaton();
+	void Wake( const Scene& scene );
+	void Step( Scene& scene );
+	uint Active() const { return (uint)active.size(); }	// bricks simulated in the last step
+	uint Changed() const { return (uint)changed.size(); }
+private:
+	uint UpdateBrick( uint* grid, const uint brick ) const;
+	void Activate( const uint brick );
+	vector<uint> active, next, changed;
+	uchar* queued;				// per brick: in 'next'
+	uchar* touched;				// per brick: in 'changed'
+	uint step = 0;
+};
+
+} // namespace Tmpl8
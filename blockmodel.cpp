@@ -0,0 +1,96 @@
+#include "template.h"
+
+bool BlockModel::Open( const char* file )
+{
+	// fails without a message for files in other formats, such as .bin models
+	Close();
+	if (!mapped.Open( file )) return false;
+	header = (const Header*)mapped.data;
+	if (mapped.size >= sizeof( Header ) && header->magic == BLOCKMODEL_MAGIC && header->version == BLOCKMODEL_VERSION && header->blockVoxels > 0)
+	{
+		const uint64_t voxels = (uint64_t)header->sx * header->sy * header->sz;
+		const size_t indexEnd = sizeof( Header ) + header->blockCount * sizeof( Block );
+		if (header->blockCount == (voxels + header->blockVoxels - 1) / header->blockVoxels && indexEnd <= mapped.size)
+		{
+			index = (const Block*)(mapped.data + sizeof( Header ));
+			return true;
+		}
+	}
+	Close();
+	return false;
+}
+
+void BlockModel::Close()
+{
+	mapped.Close();
+	header = 0, index = 0;
+}
+
+uint BlockModel::Voxels( const int block ) const
+{
+	// the last block may be partial
+	const uint64_t first = (uint64_t)block * header->blockVoxels;
+	return (uint)min( (uint64_t)header->blockVoxels, (uint64_t)header->sx * header->sy * header->sz - first );
+}
+
+bool BlockModel::Inflate( const int block, uint* dest ) const
+{
+	// returns false for a damaged or truncated block; safe to call from several threads
+	const Block& b = index[block];
+	if (b.offset > mapped.size || b.bytes > mapped.size - b.offset) return false;
+	uLongf bytes = Voxels( block ) * sizeof( uint );
+	const uLongf expected = bytes;
+	if (uncompress( (Bytef*)dest, &bytes, mapped.data + b.offset, b.bytes ) != Z_OK || bytes != expected) return false;
+	for (uint i = 0; i < Voxels( block ); i++) dest[i] &= MODEL_ALBEDO;
+	return true;
+}
+
+bool BlockModel::Convert( const char* binFile, const char* vxbFile, const uint blockVoxels )
+{
+	// read the entire .bin model, then deflate the blocks in parallel
+	gzFile in = gzopen( binFile, "rb" );
+	if (!in) return false;
+	uint size[3];
+	if (gzread( in, size, sizeof( size ) ) != sizeof( size )) { gzclose( in ); return false; }
+	const size_t voxels = (size_t)size[0] * size[1] * size[2];
+	vector<uint> data( voxels );
+	size_t done = 0;
+	while (done < voxels)
+	{
+		// gzread takes an int byte count; read large models in parts
+		const size_t part = min( voxels - done, (size_t)1 << 28 );
+		if (gzread( in, data.data() + done, (uint)(part * sizeof( uint )) ) != (int)(part * sizeof( uint ))) break;
+		done += part;
+	}
+	gzclose( in );
+	if (done < voxels) return false;
+	const int blockCount = (int)((voxels + blockVoxels - 1) / blockVoxels);
+	vector<vector<uchar>> blocks( blockCount );
+	atomic<bool> failed = false;
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < blockCount; i++)
+	{
+		const size_t first = (size_t)i * blockVoxels, bytes = min( (size_t)blockVoxels, voxels - first ) * sizeof( uint );
+		uLongf packed = compressBound( (uLong)bytes );
+		blocks[i].resize( packed );
+		if (compress2( blocks[i].data(), &packed, (const Bytef*)(data.data() + first), (uLong)bytes, Z_BEST_COMPRESSION ) != Z_OK) failed = true;
+		blocks[i].resize( packed );
+	}
+	if (failed) return false;
+	// header, index, blocks
+	FILE* out = fopen( vxbFile, "wb" );
+	if (!out) return false;
+	const Header header = { BLOCKMODEL_MAGIC, BLOCKMODEL_VERSION, size[0], size[1], size[2], blockVoxels, (uint)blockCount, 0 };
+	fwrite( &header, sizeof( Header ), 1, out );
+	uint64_t offset = sizeof( Header ) + blockCount * sizeof( Block );
+	for (int i = 0; i < blockCount; i++)
+	{
+		const Block block = { offset, (uint)blocks[i].size(), 0 };
+		fwrite( &block, sizeof( Block ), 1, out );
+		offset += block.bytes;
+	}
+	for (int i = 0; i < blockCount; i++) fwrite( blocks[i].data(), 1, blocks[i].size(), out );
+	const bool ok = ferror( out ) == 0;
+	fclose( out );
+	return ok;
+}
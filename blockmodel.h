@@ -0,0 +1,44 @@
+#pragma once
+
+#define BLOCKMODEL_MAGIC	0x4d425856	// 'VXBM'
+#define BLOCKMODEL_VERSION	1
+
+namespace Tmpl8 {
+
+// BlockModel: voxel model container for parallel loading (.vxb).
+// The voxels are those of a .bin model (x * y * z uints, x fastest), split in
+// blocks of 'blockVoxels' voxels that are deflated independently, so that
+// blocks can be inflated on all cores at once. Layout: a header, an index with
+// one entry per block, and the compressed blocks. The file is read through a
+// memory mapping. Convert turns a .bin model into a .vxb file; the renderer
+// does this when started with: -convert <model.bin> <model.vxb>.
+// Scene::LoadModel, VoxelModel::Load and ModelReader accept both formats.
+// As for .bin models, Inflate keeps only the albedo of a voxel, see MODEL_ALBEDO.
+class BlockModel
+{
+public:
+	struct Header
+	{
+		uint magic, version;
+		uint sx, sy, sz;			// model size
+		uint blockVoxels, blockCount, dummy;
+	};
+	struct Block
+	{
+		uint64_t offset;			// of the compressed data, in bytes from the start of the file
+		uint bytes, dummy;			// size of the compressed data
+	};
+	BlockModel() = default;
+	~BlockModel() { Close(); }
+	bool Open( const char* file );
+	void Close();
+	uint Voxels( const int block ) const;
+	bool Inflate( const int block, uint* dest ) const;
+	static bool Convert( const char* binFile, const char* vxbFile, const uint blockVoxels = 65536 );
+	// data members
+	const Header* header = 0;
+	const Block* index = 0;
+	MappedFile mapped;
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,65 @@
+#include "template.h"
+
+const uint BrickStore::empty[BRICKSIZE] = {};
+
+BrickStore::~BrickStore()
+{
+	for (size_t i = 1; i < brick.size(); i++) FREE64( brick[i].voxels );
+}
+
+uint64_t BrickStore::Hash( const uint* voxels )
+{
+	// 64-bit multiply / xor-shift over pairs of voxels
+	const uint64_t* v = (const uint64_t*)voxels;
+	uint64_t h = 0x9e3779b97f4a7c15ull;
+	for (int i = 0; i < BRICKSIZE / 2; i++) h = (h ^ v[i]) * 0xff51afd7ed558ccdull, h ^= h >> 32;
+	return h;
+}
+
+uint BrickStore::Add( const uint* voxels )
+{
+	// find an identical brick; all-zero bricks are not stored at all
+	static const uint64_t emptyHash = Hash( empty );
+	const uint64_t h = Hash( voxels );
+	if (h == emptyHash && memcmp( voxels, empty, sizeof( empty ) ) == 0) return 0;
+	references++;
+	const auto range = lookup.equal_range( h );
+	for (auto it = range.first; it != range.second; it++)
+	{
+		Brick& b = brick[it->second];
+		if (memcmp( b.voxels, voxels, BRICKSIZE * sizeof( uint ) ) == 0) { b.refs++; return it->second; }
+	}
+	// a new brick
+	uint id;
+	if (freeIds.empty()) id = (uint)brick.size(), brick.push_back( Brick() );
+	else id = freeIds.back(), freeIds.pop_back();
+	Brick& b = brick[id];
+	b.voxels = (uint*)MALLOC64( BRICKSIZE * sizeof( uint ) );
+	memcpy( b.voxels, voxels, BRICKSIZE * sizeof( uint ) );
+	b.hash = h, b.refs = 1;
+	lookup.insert( make_pair( h, id ) );
+	return id;
+}
+
+uint BrickStore::Replace( const uint id, const uint* voxels )
+{
+	// copy on write: returns the id for the new contents and releases the old
+	// brick, which may still be used elsewhere. Unchanged bricks keep their id.
+	if (memcmp( Get( id ), voxels, BRICKSIZE * sizeof( uint ) ) == 0) return id;
+	const uint newId = Add( voxels );
+	Release( id );
+	return newId;
+}
+
+void BrickStore::Release( const uint id )
+{
+	if (id == 0) return;
+	references--;
+	Brick& b = brick[id];
+	if (--b.refs) return;
+	const auto range = lookup.equal_range( b.hash );
+	for (auto it = range.first; it != range.second; it++) if (it->second == id) { lookup.erase( it ); break; }
+	FREE64( b.voxels );
+	b.voxels = 0;
+	freeIds.push_back( id );
+}
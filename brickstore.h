@@ -0,0 +1,39 @@
+#pragma once
+
+namespace Tmpl8 {
+
+// BrickStore: hash-consed storage for bricks of BRICKSIZE voxels.
+// Identical bricks are stored once and reference counted; Add returns the id
+// of an existing copy if there is one. Id 0 is the empty brick, which takes no
+// storage. Stored bricks are never modified: a brick that changes is added as
+// a new brick, and the old one is released by its owner (copy on write), so
+// other owners of the old brick are not affected.
+class BrickStore
+{
+public:
+	BrickStore() = default;
+	~BrickStore();
+	uint Add( const uint* voxels );
+	uint Replace( const uint id, const uint* voxels );
+	void Release( const uint id );
+	const uint* Get( const uint id ) const { return id ? brick[id].voxels : empty; }
+	// statistics
+	uint Unique() const { return (uint)(brick.size() - 1 - freeIds.size()); }
+	uint References() const { return references; }
+	size_t MemoryUsed() const { return (size_t)Unique() * (BRICKSIZE * sizeof( uint ) + sizeof( Brick )); }
+private:
+	struct Brick
+	{
+		uint* voxels;
+		uint64_t hash;
+		uint refs;
+	};
+	static uint64_t Hash( const uint* voxels );
+	vector<Brick> brick = vector<Brick>( 1 );	// brick[0] is unused
+	vector<uint> freeIds;
+	unordered_multimap<uint64_t, uint> lookup;	// hash to brick id
+	uint references = 0;			// non-empty bricks held by owners
+	static const uint empty[BRICKSIZE];
+};
+
+} // namespace Tmpl8
@@ -2,30 +2,32 @@
 
 Camera::Camera()
 {
-	// try to load a camera
-	FILE* f = fopen( "camera.bin", "rb" );
-	if (f)
-	{
-		fread( this, 1, sizeof( Camera ), f );
-		fclose( f );
-	}
-	else
-	{
-		// setup a basic view frustum
-		camPos = float3( 0, 0, -2 );
-		camTarget = float3( 0, 0, -1 );
-		topLeft = float3( -aspect, 1, 0 );
-		topRight = float3( aspect, 1, 0 );
-		bottomLeft = float3( -aspect, -1, 0 );
-	}
+	// setup a basic view frustum; a snapshot may replace it, see Restore
+	camPos = float3( 0, 0, -2 );
+	camTarget = float3( 0, 0, -1 );
+	topLeft = float3( -aspect, 1, 0 );
+	topRight = float3( aspect, 1, 0 );
+	bottomLeft = float3( -aspect, -1, 0 );
 }
 
 Camera::~Camera()
 {
-	// save current camera
-	FILE* f = fopen( "camera.bin", "wb" );
-	fwrite( this, 1, sizeof( Camera ), f );
-	fclose( f );
+}
+
+void Camera::Save( Snapshot& snapshot ) const
+{
+	snapshot.BeginSection( SECTION_CAMERA, 1 );
+	snapshot.Write( camPos ), snapshot.Write( camTarget );
+	snapshot.Write( topLeft ), snapshot.Write( topRight ), snapshot.Write( bottomLeft );
+	snapshot.EndSection();
+}
+
+void Camera::Restore( Snapshot& snapshot )
+{
+	uint version;
+	if (!snapshot.FindSection( SECTION_CAMERA, version ) || version != 1) return;
+	snapshot.Read( camPos ), snapshot.Read( camTarget );
+	snapshot.Read( topLeft ), snapshot.Read( topRight ), snapshot.Read( bottomLeft );
 }
 
 Ray Camera::GetPrimaryRay( const float x, const float y )
@@ -73,4 +75,11 @@ bool Camera::HandleInput( const float t )
 	bottomLeft = camPos + 2 * ahead - aspect * right - up;
 	if (!changed) return false;
 	return true;
-}
\ No newline at end of file
+}
+
+void Camera::Translate( const float3& offset )
+{
+	// move the camera without changing its orientation
+	camPos += offset, camTarget += offset;
+	topLeft += offset, topRight += offset, bottomLeft += offset;
+}
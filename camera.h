@@ -15,6 +15,9 @@ public:
 	~Camera();
 	Ray GetPrimaryRay( const float x, const float y );
 	bool HandleInput( const float t );
+	void Translate( const float3& offset );
+	void Save( Snapshot& snapshot ) const;
+	void Restore( Snapshot& snapshot );
 	float aspect = (float)SCRWIDTH / (float)SCRHEIGHT;
 	float3 camPos, camTarget;
 	float3 topLeft, topRight, bottomLeft;
@@ -0,0 +1,161 @@
+#include "template.h"
+
+#define TILESIZE	32
+#define TILESX		((SCRWIDTH + TILESIZE - 1) / TILESIZE)
+#define TILESY		((SCRHEIGHT + TILESIZE - 1) / TILESIZE)
+
+// B3 spline kernel weights
+static const float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+// exp(x) for x <= 0, 8-wide; accurate to ~1e-6 relative, which is plenty for weights
+static inline __m256 FastExp8( const __m256 x )
+{
+	const __m256 t = _mm256_mul_ps( _mm256_max_ps( x, _mm256_set1_ps( -87.0f ) ), _mm256_set1_ps( 1.442695041f ) );
+	const __m256 fi = _mm256_floor_ps( t ), f = _mm256_sub_ps( t, fi );
+	__m256 p = _mm256_fmadd_ps( _mm256_set1_ps( 0.001333355f ), f, _mm256_set1_ps( 0.009618129f ) );
+	p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 0.05550411f ) );
+	p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 0.2402265f ) );
+	p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 0.6931472f ) );
+	p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 1.0f ) );
+	const __m256i e = _mm256_slli_epi32( _mm256_add_epi32( _mm256_cvtps_epi32( fi ), _mm256_set1_epi32( 127 ) ), 23 );
+	return _mm256_mul_ps( p, _mm256_castsi256_ps( e ) );
+}
+
+Denoiser::Denoiser()
+{
+	const int n = SCRWIDTH * SCRHEIGHT;
+	depth = (float*)MALLOC64( n * sizeof( float ) );
+	normal = (uint*)MALLOC64( n * sizeof( uint ) );
+	voxel = (uint*)MALLOC64( n * sizeof( uint ) );
+	key = (uint*)MALLOC64( n * sizeof( uint ) );
+	albedo = (float3*)MALLOC64( n * sizeof( float3 ) );
+	for (int i = 0; i < 3; i++)
+		src[i] = (float*)MALLOC64( n * sizeof( float ) ),
+		dst[i] = (float*)MALLOC64( n * sizeof( float ) );
+}
+
+Denoiser::~Denoiser()
+{
+	FREE64( depth );
+	FREE64( normal );
+	FREE64( voxel );
+	FREE64( key );
+	FREE64( albedo );
+	for (int i = 0; i < 3; i++) FREE64( src[i] ), FREE64( dst[i] );
+}
+
+void Denoiser::Apply( float3* pixels )
+{
+	const int n = SCRWIDTH * SCRHEIGHT;
+	// divide out albedo and convert to planar layout
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < n; i++)
+	{
+		const uint v = voxel[i];
+		// offset albedo slightly so that black voxels survive the round trip
+		albedo[i] = v ? RGB8_to_RGBF32( v ) + 0.01f : float3( 1 );
+		key[i] = v ? ((v >> 24) | 0x100) : 0;
+		src[0][i] = pixels[i].x / albedo[i].x;
+		src[1][i] = pixels[i].y / albedo[i].y;
+		src[2][i] = pixels[i].z / albedo[i].z;
+	}
+	// a-trous passes, parallel over tiles
+	for (int pass = 0; pass < iterations; pass++)
+	{
+	#pragma omp parallel for schedule(dynamic)
+		for (int tile = 0; tile < TILESX * TILESY; tile++)
+		{
+			const int x0 = (tile % TILESX) * TILESIZE, y0 = (tile / TILESX) * TILESIZE;
+			Filter( pass, x0, y0, min( x0 + TILESIZE, SCRWIDTH ), min( y0 + TILESIZE, SCRHEIGHT ) );
+		}
+		for (int i = 0; i < 3; i++) swap( src[i], dst[i] );
+	}
+	// multiply albedo back in
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < n; i++) pixels[i] = float3( src[0][i], src[1][i], src[2][i] ) * albedo[i];
+}
+
+void Denoiser::Filter( const int pass, const int x0, const int y0, const int x1, const int y1 )
+{
+	const int step = 1 << pass, reach = 2 * step;
+	const float sc = sigmaColor / step;
+	const __m256 invColor8 = _mm256_set1_ps( 1.0f / (sc * sc) ), invDepth8 = _mm256_set1_ps( 1.0f / sigmaDepth );
+	const __m256 zero8 = _mm256_setzero_ps();
+	for (int y = y0; y < y1; y++) for (int x = x0; x < x1; x += 8)
+	{
+		if (x - reach < 0 || x + 7 + reach >= SCRWIDTH || x + 8 > x1)
+		{
+			// near the screen edge: scalar code with bounds checks
+			for (int i = x; i < min( x + 8, x1 ); i++)
+			{
+				float3 out;
+				FilterPixel( pass, i, y, out );
+				const int idx = i + y * SCRWIDTH;
+				dst[0][idx] = out.x, dst[1][idx] = out.y, dst[2][idx] = out.z;
+			}
+			continue;
+		}
+		// 8 pixels at once
+		const int c = x + y * SCRWIDTH;
+		const __m256 cr = _mm256_loadu_ps( src[0] + c ), cg = _mm256_loadu_ps( src[1] + c ), cb = _mm256_loadu_ps( src[2] + c );
+		const __m256 cz = _mm256_loadu_ps( depth + c ), invZ = _mm256_div_ps( invDepth8, _mm256_max_ps( cz, _mm256_set1_ps( EPSILON ) ) );
+		const __m256i cn = _mm256_loadu_si256( (__m256i*)(normal + c) ), ck = _mm256_loadu_si256( (__m256i*)(key + c) );
+		__m256 sr = zero8, sg = zero8, sb = zero8, sw = zero8;
+		for (int v = -2; v <= 2; v++)
+		{
+			const int yy = y + v * step;
+			if (yy < 0 || yy >= SCRHEIGHT) continue;
+			for (int u = -2; u <= 2; u++)
+			{
+				const int q = x + u * step + yy * SCRWIDTH;
+				const __m256 qr = _mm256_loadu_ps( src[0] + q ), qg = _mm256_loadu_ps( src[1] + q ), qb = _mm256_loadu_ps( src[2] + q );
+				const __m256 dr = _mm256_sub_ps( qr, cr ), dg = _mm256_sub_ps( qg, cg ), db = _mm256_sub_ps( qb, cb );
+				const __m256 dc2 = _mm256_fmadd_ps( dr, dr, _mm256_fmadd_ps( dg, dg, _mm256_mul_ps( db, db ) ) );
+				const __m256 dz = _mm256_mul_ps( _mm256_sub_ps( _mm256_loadu_ps( depth + q ), cz ), invZ );
+				const __m256 e = _mm256_min_ps( _mm256_fmadd_ps( dc2, invColor8, _mm256_mul_ps( dz, dz ) ), _mm256_set1_ps( 80.0f ) );
+				// reject taps with a different normal or material
+				const __m256i same = _mm256_and_si256(
+					_mm256_cmpeq_epi32( _mm256_loadu_si256( (__m256i*)(normal + q) ), cn ),
+					_mm256_cmpeq_epi32( _mm256_loadu_si256( (__m256i*)(key + q) ), ck ) );
+				const __m256 w = _mm256_and_ps( _mm256_castsi256_ps( same ),
+					_mm256_mul_ps( _mm256_set1_ps( kernel[u + 2] * kernel[v + 2] ), FastExp8( _mm256_sub_ps( zero8, e ) ) ) );
+				sr = _mm256_fmadd_ps( w, qr, sr ), sg = _mm256_fmadd_ps( w, qg, sg ), sb = _mm256_fmadd_ps( w, qb, sb );
+				sw = _mm256_add_ps( sw, w );
+			}
+		}
+		// the center tap always contributes, so sw > 0; sky pixels pass through
+		const __m256 rcp = _mm256_div_ps( _mm256_set1_ps( 1 ), sw );
+		const __m256 sky = _mm256_castsi256_ps( _mm256_cmpeq_epi32( ck, _mm256_setzero_si256() ) );
+		_mm256_storeu_ps( dst[0] + c, _mm256_blendv_ps( _mm256_mul_ps( sr, rcp ), cr, sky ) );
+		_mm256_storeu_ps( dst[1] + c, _mm256_blendv_ps( _mm256_mul_ps( sg, rcp ), cg, sky ) );
+		_mm256_storeu_ps( dst[2] + c, _mm256_blendv_ps( _mm256_mul_ps( sb, rcp ), cb, sky ) );
+	}
+}
+
+void Denoiser::FilterPixel( const int pass, const int x, const int y, float3& out ) const
+{
+	const int c = x + y * SCRWIDTH, step = 1 << pass;
+	const float3 C( src[0][c], src[1][c], src[2][c] );
+	out = C;
+	if (!key[c]) return; // sky
+	const float sc = sigmaColor / step, invColor = 1.0f / (sc * sc), invZ = 1.0f / (sigmaDepth * max( depth[c], EPSILON ));
+	float3 sum( 0 );
+	float sw = 0;
+	for (int v = -2; v <= 2; v++)
+	{
+		const int yy = y + v * step;
+		if (yy < 0 || yy >= SCRHEIGHT) continue;
+		for (int u = -2; u <= 2; u++)
+		{
+			const int xx = x + u * step;
+			if (xx < 0 || xx >= SCRWIDTH) continue;
+			const int q = xx + yy * SCRWIDTH;
+			if (normal[q] != normal[c] || key[q] != key[c]) continue;
+			const float3 Q( src[0][q], src[1][q], src[2][q] ), d = Q - C;
+			const float dz = (depth[q] - depth[c]) * invZ;
+			const float w = kernel[u + 2] * kernel[v + 2] * expf( -min( dot( d, d ) * invColor + dz * dz, 80.0f ) );
+			sum += w * Q, sw += w;
+		}
+	}
+	out = sum * (1.0f / sw);
+}
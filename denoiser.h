@@ -0,0 +1,34 @@
+#pragma once
+
+namespace Tmpl8 {
+
+// Denoiser: edge-avoiding a-trous wavelet filter (Dammertz et al., 2010)
+// for the float3 accumulator. The renderer fills the guide buffers while
+// tracing primary rays. Albedo is divided out before filtering, so only
+// lighting is blurred; colour bits in the voxel payload therefore do not
+// stop the filter, but the remaining payload bits act as a material id.
+// Rows are processed 8 pixels at a time with AVX2, tiles in parallel.
+class Denoiser
+{
+public:
+	Denoiser();
+	~Denoiser();
+	void Apply( float3* pixels );
+	// guide buffers, written by the renderer
+	float* depth;				// primary ray distance; 1e34f for sky
+	uint* normal;				// voxel normal: axis * 2 + (sign > 0)
+	uint* voxel;				// voxel payload; 0 for sky
+	// settings
+	bool enabled = true;
+	int iterations = 4;			// a-trous passes; step size doubles each pass
+	float sigmaColor = 1.0f;	// halved every pass
+	float sigmaDepth = 0.05f;	// relative to pixel depth
+private:
+	void Filter( const int pass, const int x0, const int y0, const int x1, const int y1 );
+	void FilterPixel( const int pass, const int x, const int y, float3& out ) const;
+	float* src[3], *dst[3];		// planar demodulated lighting, ping-pong
+	float3* albedo;				// demodulation factors
+	uint* key;					// hit flag plus material bits, per pixel
+};
+
+} // namespace Tmpl8
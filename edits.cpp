@@ -0,0 +1,162 @@
+#include "template.h"
+
+EditQueue::~EditQueue()
+{
+	for (auto& version : working) delete version.second;
+	for (Version* version : committed) delete version;
+}
+
+static bool Rebase( uint& brick, const int3 bricks )
+{
+	// the brick that shows the same part of the world after the window moved
+	const int3 b = make_int3( brick % GRIDBRICKS, (brick / GRIDBRICKS) % GRIDBRICKS, brick / GRIDBRICKS2 ) - bricks;
+	if (b.x < 0 || b.y < 0 || b.z < 0 || b.x >= GRIDBRICKS || b.y >= GRIDBRICKS || b.z >= GRIDBRICKS) return false;
+	brick = b.x + b.y * GRIDBRICKS + b.z * GRIDBRICKS2;
+	return true;
+}
+
+void EditQueue::Follow()
+{
+	// move the working copies along with the window, if it moved
+	if (shifts == workingShifts) return;
+	int3 bricks;
+	{
+		lock_guard<mutex> guard( lock );
+		bricks = offset - workingOffset;
+		workingOffset = offset, workingShifts = shifts;
+	}
+	unordered_map<uint, Version*> moved;
+	for (auto& it : working)
+	{
+		Version* version = it.second;
+		if (Rebase( version->brick, bricks )) moved[version->brick] = version; else delete version;
+	}
+	working.swap( moved );
+}
+
+EditQueue::Version* EditQueue::Touch( const uint brick )
+{
+	// copy on write: the private copy starts from the newest version of the brick
+	Follow();
+	const auto it = working.find( brick );
+	if (it != working.end()) return it->second;
+	Version* version = new Version;
+	version->brick = brick, version->epoch = 0;
+	memset( version->written, 0, sizeof( version->written ) );
+	{
+		shared_lock<shared_mutex> frame( frameLock );
+		lock_guard<mutex> guard( lock );
+		const auto newest = latest.find( brick );
+		if (newest != latest.end()) memcpy( version->voxels, newest->second->voxels, sizeof( version->voxels ) );
+		else
+		{
+			const uint x = (brick % GRIDBRICKS) * BRICKDIM, y = ((brick / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM, z = (brick / GRIDBRICKS2) * BRICKDIM;
+			for (int i = 0; i < BRICKDIM * BRICKDIM; i++)
+				memcpy( version->voxels + i * BRICKDIM, scene.grid + x + (y + i % BRICKDIM) * GRIDSIZE + (z + i / BRICKDIM) * GRIDSIZE2, BRICKDIM * sizeof( uint ) );
+		}
+	}
+	working[brick] = version;
+	return version;
+}
+
+uint EditQueue::Get( const uint x, const uint y, const uint z )
+{
+	// reads see the editing thread's own uncommitted edits
+	const uint local = (x % BRICKDIM) + (y % BRICKDIM) * BRICKDIM + (z % BRICKDIM) * BRICKDIM * BRICKDIM;
+	Follow();
+	const auto it = working.find( Scene::BrickIndex( x, y, z ) );
+	if (it != working.end()) return it->second->voxels[local];
+	shared_lock<shared_mutex> frame( frameLock );
+	lock_guard<mutex> guard( lock );
+	const auto newest = latest.find( Scene::BrickIndex( x, y, z ) );
+	return newest != latest.end() ? newest->second->voxels[local] : scene.grid[x + y * GRIDSIZE + z * GRIDSIZE2];
+}
+
+void EditQueue::Set( const uint x, const uint y, const uint z, const uint v )
+{
+	Version* version = Touch( Scene::BrickIndex( x, y, z ) );
+	const uint local = (x % BRICKDIM) + (y % BRICKDIM) * BRICKDIM + (z % BRICKDIM) * BRICKDIM * BRICKDIM;
+	version->voxels[local] = v, version->written[local >> 6] |= 1ull << (local & 63);
+}
+
+void EditQueue::FillBox( const int3 bmin, const int3 bmax, const uint v )
+{
+	// as Scene::FillBox, brick by brick
+	const int3 lo = max( bmin, make_int3( 0 ) ), hi = min( bmax, make_int3( GRIDSIZE ) );
+	for (int bz = lo.z / BRICKDIM; bz * BRICKDIM < hi.z; bz++) for (int by = lo.y / BRICKDIM; by * BRICKDIM < hi.y; by++)
+		for (int bx = lo.x / BRICKDIM; bx * BRICKDIM < hi.x; bx++)
+		{
+			Version* version = Touch( bx + by * GRIDBRICKS + bz * GRIDBRICKS2 );
+			const int3 b = make_int3( bx, by, bz ) * BRICKDIM;
+			const int3 p0 = max( lo, b ) - b, p1 = min( hi, b + BRICKDIM ) - b;
+			for (int z = p0.z; z < p1.z; z++) for (int y = p0.y; y < p1.y; y++) for (int x = p0.x; x < p1.x; x++)
+			{
+				const uint local = x + y * BRICKDIM + z * BRICKDIM * BRICKDIM;
+				version->voxels[local] = v, version->written[local >> 6] |= 1ull << (local & 63);
+			}
+		}
+}
+
+uint EditQueue::Commit()
+{
+	// hand over the private copies as one batch; returns its epoch
+	lock_guard<mutex> guard( lock );
+	const uint epoch = ++commitEpoch;
+	for (auto& it : working)
+	{
+		Version* version = it.second;
+		version->epoch = epoch;
+		committed.push_back( version );
+		latest[version->brick] = version;
+	}
+	working.clear();
+	return epoch;
+}
+
+void EditQueue::Apply( Scene& target )
+{
+	// merge the written voxels of the committed batches into the grid, oldest
+	// first; the caller holds frameLock exclusively
+	vector<Version*> batch;
+	{
+		lock_guard<mutex> guard( lock );
+		batch.swap( committed );
+		for (Version* version : batch)
+		{
+			const auto newest = latest.find( version->brick );
+			if (newest != latest.end() && newest->second == version) latest.erase( newest );
+		}
+		appliedEpoch = commitEpoch.load();
+	}
+	for (Version* version : batch)
+	{
+		const uint brick = version->brick;
+		const uint x = (brick % GRIDBRICKS) * BRICKDIM, y = ((brick / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM, z = (brick / GRIDBRICKS2) * BRICKDIM;
+		for (int i = 0; i < BRICKSIZE / 64; i++) for (uint64_t bits = version->written[i]; bits; bits &= bits - 1)
+		{
+			const uint local = i * 64 + (uint)_mm_popcnt_u64( (bits & (0 - bits)) - 1 );
+			target.grid[x + (local % BRICKDIM) + (y + (local / BRICKDIM) % BRICKDIM) * GRIDSIZE + (z + local / (BRICKDIM * BRICKDIM)) * GRIDSIZE2] = version->voxels[local];
+		}
+		target.MarkDirty( brick );
+		delete version;
+	}
+}
+
+void EditQueue::Shift( const int3 bricks )
+{
+	// the pager moved the window; the caller holds frameLock exclusively.
+	// Committed copies move now, the working copies of the editing thread at
+	// its next call.
+	if (bricks.x == 0 && bricks.y == 0 && bricks.z == 0) return;
+	lock_guard<mutex> guard( lock );
+	vector<Version*> moved;
+	latest.clear();
+	for (Version* version : committed) if (Rebase( version->brick, bricks ))
+	{
+		moved.push_back( version );
+		latest[version->brick] = version;
+	}
+	else delete version;
+	committed.swap( moved );
+	offset = offset + bricks, shifts++;
+}
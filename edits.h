@@ -0,0 +1,61 @@
+#pragma once
+
+namespace Tmpl8 {
+
+// EditQueue: world edits from other threads, such as game logic, made while
+// the renderer traces the grid.
+// The editing thread never writes the grid. The first edit of a brick copies
+// it (copy on write), and later edits go to that private copy, which also
+// marks the voxels that were written. Commit hands all copies over as one
+// batch, tagged with the next epoch. Apply runs on the main thread between
+// frames, while no rays are traced. It merges the written voxels of every
+// committed batch into the grid, so a batch shows up in full at the start of
+// a frame, never halfway through one; the other voxels of a brick may have
+// been changed since it was copied, by the automaton for instance, and are
+// left alone. Reclamation is deferred: a copy is freed after Apply, unless
+// the editing thread still bases newer edits on it.
+// The main thread holds 'frameLock' exclusively while it writes the grid
+// between frames. The editing thread holds it shared when it copies a brick
+// from the grid, as physics queries do, and it never waits for a frame to
+// finish.
+// A single thread should edit at a time; Commit may be called at any rate.
+// Coordinates are grid coordinates of the window at the time of the call.
+// When the pager moves the window, Shift moves the pending edits along with
+// the world; edits that leave the window are dropped.
+class EditQueue
+{
+public:
+	EditQueue( const Scene& scene ) : scene( scene ) {}
+	~EditQueue();
+	// editing thread
+	uint Get( const uint x, const uint y, const uint z );
+	void Set( const uint x, const uint y, const uint z, const uint v );
+	void FillBox( const int3 bmin, const int3 bmax, const uint v );
+	uint Commit();
+	// main thread, between frames
+	void Apply( Scene& target );
+	void Shift( const int3 bricks );
+	uint Epoch() const { return appliedEpoch; }	// last epoch visible in the grid
+	shared_mutex frameLock;
+private:
+	struct Version
+	{
+		uint brick, epoch;
+		uint voxels[BRICKSIZE];		// x, y, z order
+		uint64_t written[BRICKSIZE / 64];	// a bit per voxel set by the editing thread
+	};
+	Version* Touch( const uint brick );
+	void Follow();
+	const Scene& scene;
+	unordered_map<uint, Version*> working;	// uncommitted copies of the editing thread
+	mutex lock;						// guards committed and latest
+	vector<Version*> committed;		// in commit order
+	unordered_map<uint, Version*> latest;	// newest committed version per brick, until applied
+	atomic<uint> commitEpoch = 0, appliedEpoch = 0;
+	int3 offset = make_int3( 0 );	// window shifts so far, in bricks; guarded by lock
+	atomic<uint> shifts = 0;
+	int3 workingOffset = make_int3( 0 );	// offset the working copies are based on
+	uint workingShifts = 0;
+};
+
+} // namespace Tmpl8
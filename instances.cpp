@@ -0,0 +1,511 @@
+#include "template.h"
+
+VoxelModel::~VoxelModel()
+{
+	for (int i = 1; i < mips; i++) FREE64( mip[i].voxels );
+	FREE64( voxels );
+}
+
+bool VoxelModel::Load( const char* file )
+{
+	// inflate the model into its own grid; no clipping, no rotation
+	for (int i = 1; i < mips; i++) FREE64( mip[i].voxels );
+	FREE64( voxels );
+	mips = 0;
+	BlockModel blocked;
+	if (blocked.Open( file ))
+	{
+		// blocks of a block model are inflated in parallel, directly in place
+		const BlockModel::Header& h = *blocked.header;
+		size = make_int3( h.sx, h.sy, h.sz );
+		voxels = (uint*)MALLOC64( (size_t)size.x * size.y * size.z * sizeof( uint ) );
+		atomic<bool> damaged = false;
+	#pragma omp parallel for schedule(dynamic)
+		for (int b = 0; b < (int)h.blockCount; b++)
+			if (!blocked.Inflate( b, voxels + (size_t)b * h.blockVoxels )) damaged = true;
+		BuildMips();
+		return !damaged;
+	}
+	ModelReader reader;
+	if (!reader.Open( file, make_int3( 0 ), 0, false )) return false;
+	size = make_int3( reader.sx, reader.sy, reader.sz );
+	const size_t count = (size_t)size.x * size.y * size.z;
+	voxels = (uint*)MALLOC64( count * sizeof( uint ) );
+	memset( voxels, 0, count * sizeof( uint ) );
+	uint x, y, z, v;
+	while (reader.Next( x, y, z, v )) voxels[x + y * size.x + z * size.x * size.y] = v;
+	BuildMips();
+	return !reader.truncated;
+}
+
+void VoxelModel::Create( const int3 dim, const uint* data )
+{
+	// a model from voxels in memory, x + y * dim.x + z * dim.x * dim.y
+	for (int i = 1; i < mips; i++) FREE64( mip[i].voxels );
+	FREE64( voxels );
+	size = dim;
+	const size_t bytes = (size_t)size.x * size.y * size.z * sizeof( uint );
+	voxels = (uint*)MALLOC64( bytes );
+	memcpy( voxels, data, bytes );
+	BuildMips();
+}
+
+void VoxelModel::BuildMips()
+{
+	// each level is built from the one below it, until a level is a single voxel
+	mip[0].size = size, mip[0].voxels = voxels, mips = 1;
+	while (mips < MAXMODELMIPS && (mip[mips - 1].size.x > 1 || mip[mips - 1].size.y > 1 || mip[mips - 1].size.z > 1))
+	{
+		const Mip& src = mip[mips - 1];
+		Mip& dst = mip[mips++];
+		dst.size = make_int3( (src.size.x + 1) / 2, (src.size.y + 1) / 2, (src.size.z + 1) / 2 );
+		dst.voxels = (uint*)MALLOC64( (size_t)dst.size.x * dst.size.y * dst.size.z * sizeof( uint ) );
+	#pragma omp parallel for schedule(dynamic)
+		for (int z = 0; z < dst.size.z; z++) for (int y = 0; y < dst.size.y; y++) for (int x = 0; x < dst.size.x; x++)
+		{
+			// gather the solid voxels of the (up to) 2x2x2 block below
+			uint solid[8], n = 0, r = 0, g = 0, b = 0;
+			for (int i = 0; i < 8; i++)
+			{
+				const int sx = x * 2 + (i & 1), sy = y * 2 + ((i >> 1) & 1), sz = z * 2 + (i >> 2);
+				if (sx >= src.size.x || sy >= src.size.y || sz >= src.size.z) continue;
+				const uint v = src.voxels[sx + sy * src.size.x + sz * src.size.x * src.size.y];
+				if (v) solid[n++] = v, r += (v >> 16) & 255, g += (v >> 8) & 255, b += v & 255;
+			}
+			uint result = 0;
+			if (n)
+			{
+				// majority vote over the material and flag bits
+				uint flags = solid[0] & 0xff000000, best = 0;
+				for (uint i = 0; i < n; i++)
+				{
+					uint votes = 0;
+					for (uint j = 0; j < n; j++) votes += (solid[j] & 0xff000000) == (solid[i] & 0xff000000);
+					if (votes > best) best = votes, flags = solid[i] & 0xff000000;
+				}
+				result = flags + ((r / n) << 16) + ((g / n) << 8) + b / n;
+				if (result == 0) result = 1; // black diffuse must stay solid
+			}
+			dst.voxels[x + y * dst.size.x + z * dst.size.x * dst.size.y] = result;
+		}
+	}
+}
+
+bool VoxelModel::FindNearest( const int level, const float3& Om, const float3& Dm, float& t, uint& voxel, uint& axis ) const
+{
+	// Amanatides & Woo in model space, where voxels have size 1. D need not be
+	// normalized; t is the distance of the nearest hit so far, in ray units.
+	// Level l is traversed in its own voxel units, which scales O and D alike,
+	// so t is the same at every level.
+	const int3 dim = mip[level].size;
+	const uint* grid = mip[level].voxels;
+	const float s = 1.0f / (1 << level);
+	const float3 O = Om * s, D = Dm * s;
+	const float3 rD( 1 / (D.x != 0 ? D.x : 1e-20f), 1 / (D.y != 0 ? D.y : 1e-20f), 1 / (D.z != 0 ? D.z : 1e-20f) );
+	const float3 t1 = -O * rD, t2 = (float3( dim ) - O) * rD, tnear = fminf( t1, t2 ), tfar = fmaxf( t1, t2 );
+	const float tmin = max( max( tnear.x, tnear.y ), tnear.z ), tmax = min( min( tfar.x, tfar.y ), tfar.z );
+	if (tmax < tmin || tmax <= 0 || tmin >= t) return false;
+	uint a = tmin == tnear.x ? 0 : tmin == tnear.y ? 1 : 2;
+	float tc = max( tmin, 0.0f );
+	const float3 P = O + tc * D;
+	int3 cell = clamp( make_int3( (int)floorf( P.x ), (int)floorf( P.y ), (int)floorf( P.z ) ), make_int3( 0 ), dim - 1 );
+	const int3 step = make_int3( D.x < 0 ? -1 : 1, D.y < 0 ? -1 : 1, D.z < 0 ? -1 : 1 );
+	const float3 tdelta = fabs( rD );
+	float3 tnext( (cell.x + (step.x > 0) - O.x) * rD.x, (cell.y + (step.y > 0) - O.y) * rD.y, (cell.z + (step.z > 0) - O.z) * rD.z );
+	// a ray that starts in a solid voxel leaves it first
+	bool skip = tmin <= 0;
+	while (tc < t)
+	{
+		const uint v = grid[cell.x + cell.y * dim.x + cell.z * dim.x * dim.y];
+		if (v && !skip) { t = tc, voxel = v, axis = a; return true; }
+		skip = false;
+		if (tnext.x < tnext.y && tnext.x < tnext.z)
+		{
+			tc = tnext.x, a = 0, tnext.x += tdelta.x;
+			if ((cell.x += step.x) < 0 || cell.x >= dim.x) return false;
+		}
+		else if (tnext.y < tnext.z)
+		{
+			tc = tnext.y, a = 1, tnext.y += tdelta.y;
+			if ((cell.y += step.y) < 0 || cell.y >= dim.y) return false;
+		}
+		else
+		{
+			tc = tnext.z, a = 2, tnext.z += tdelta.z;
+			if ((cell.z += step.z) < 0 || cell.z >= dim.z) return false;
+		}
+	}
+	return false;
+}
+
+TopLevelBVH::~TopLevelBVH()
+{
+	for (VoxelModel* model : models) delete model;
+	for (AnimatedModel* animation : animations) delete animation;
+	for (Instance& instance : instances) delete[] instance.table;
+}
+
+uint TopLevelBVH::AddModel( const char* file )
+{
+	VoxelModel* model = new VoxelModel();
+	if (!model->Load( file )) FatalError( "Could not load model %s", file );
+	models.push_back( model );
+	return (uint)models.size() - 1;
+}
+
+uint TopLevelBVH::AddModel( VoxelModel* model )
+{
+	// the BVH takes ownership of the model
+	models.push_back( model );
+	return (uint)models.size() - 1;
+}
+
+uint TopLevelBVH::AddInstance( const uint model, const float3& position, const int rotation, const float scale )
+{
+	// place a model; at scale 1, a model voxel is as large as a world voxel.
+	// The BVH is rebuilt on the next call to Build.
+	Instance instance;
+	instance.scale = scale / GRIDSIZE, instance.model = model;
+	instances.push_back( instance );
+	Move( (uint)instances.size() - 1, position, rotation );
+	dirty = true;
+	return (uint)instances.size() - 1;
+}
+
+uint TopLevelBVH::AddInstance( const uint model, const mat4& transform )
+{
+	// place a model with an arbitrary transform, see SetTransform
+	Instance instance;
+	instance.scale = 1.0f / GRIDSIZE, instance.model = model, instance.rotation = 0;
+	instances.push_back( instance );
+	SetTransform( (uint)instances.size() - 1, transform );
+	dirty = true;
+	return (uint)instances.size() - 1;
+}
+
+uint TopLevelBVH::AddAnimation( AnimatedModel* animation )
+{
+	// the BVH takes ownership of the animation
+	animations.push_back( animation );
+	return (uint)animations.size() - 1;
+}
+
+uint TopLevelBVH::AddAnimatedInstance( const uint animation, const float3& position, const int rotation, const float scale )
+{
+	// as AddInstance; the instance starts at frame 0
+	Instance instance;
+	instance.scale = scale / GRIDSIZE, instance.model = animation;
+	instance.table = new uint[animations[animation]->Slots()];
+	animations[animation]->Seek( instance.table, 0 );
+	instances.push_back( instance );
+	Move( (uint)instances.size() - 1, position, rotation );
+	dirty = true;
+	return (uint)instances.size() - 1;
+}
+
+void TopLevelBVH::SetFrame( const uint idx, const uint frame )
+{
+	// any frame; cost grows with the distance from frame 0
+	Instance& instance = instances[idx];
+	const AnimatedModel& animation = *animations[instance.model];
+	instance.frame = frame % animation.Frames();
+	animation.Seek( instance.table, instance.frame );
+}
+
+void TopLevelBVH::NextFrame( const uint idx )
+{
+	// the frame after the current one, looping; only the bricks that change are patched
+	Instance& instance = instances[idx];
+	const AnimatedModel& animation = *animations[instance.model];
+	animation.Next( instance.table, instance.frame );
+	instance.frame = (instance.frame + 1) % animation.Frames();
+}
+
+void TopLevelBVH::SetTransform( const uint idx, const mat4& transform )
+{
+	// 'transform' takes model space, in model voxels, to world space; e.g.,
+	// Translate( P ) * Rotate( axis, angle ) * Scale( 1.0f / GRIDSIZE ) for a
+	// model at P with its corner at the pivot. The bounds enclose the model box.
+	Instance& instance = instances[idx];
+	instance.transformed = true, instance.inverse = transform.Inverted();
+	const int3 size = Size( instance );
+	instance.bmin = float3( 1e30f ), instance.bmax = float3( -1e30f );
+	for (int i = 0; i < 8; i++)
+	{
+		const float3 corner( i & 1 ? (float)size.x : 0, i & 2 ? (float)size.y : 0, i & 4 ? (float)size.z : 0 );
+		const float3 P = TransformPosition( corner, transform );
+		instance.bmin = fminf( instance.bmin, P ), instance.bmax = fmaxf( instance.bmax, P );
+	}
+	moved = true;
+}
+
+int3 TopLevelBVH::Size( const Instance& instance ) const
+{
+	return instance.table ? animations[instance.model]->size : models[instance.model]->size;
+}
+
+void TopLevelBVH::Move( const uint idx, const float3& position, const int rotation )
+{
+	// the new bounds are taken into the tree on the next call to Refit
+	Instance& instance = instances[idx];
+	instance.position = position, instance.rotation = rotation & 3, instance.transformed = false;
+	int3 size = Size( instance );
+	if (instance.rotation & 1) swap( size.x, size.z );
+	instance.bmin = position, instance.bmax = position + float3( size ) * instance.scale;
+	moved = true;
+}
+
+void TopLevelBVH::UpdateBounds( const uint idx )
+{
+	Node& node = nodes[idx];
+	node.bmin = float3( 1e30f ), node.bmax = float3( -1e30f );
+	for (uint i = 0; i < node.count; i++)
+	{
+		const Instance& instance = instances[instanceIdx[node.leftFirst + i]];
+		node.bmin = fminf( node.bmin, instance.bmin ), node.bmax = fmaxf( node.bmax, instance.bmax );
+	}
+}
+
+void TopLevelBVH::Subdivide( const uint idx, const int depth )
+{
+	// binned SAH split over the instance centroids
+	Node& node = nodes[idx];
+	if (node.count <= 2 || depth >= 48) return;
+	const uint first = node.leftFirst;
+	float3 cmin( 1e30f ), cmax( -1e30f );
+	for (uint i = 0; i < node.count; i++)
+	{
+		const Instance& instance = instances[instanceIdx[first + i]];
+		const float3 c = (instance.bmin + instance.bmax) * 0.5f;
+		cmin = fminf( cmin, c ), cmax = fmaxf( cmax, c );
+	}
+	const int BINS = 8;
+	float bestCost = 1e30f, bestSplit = 0;
+	int bestAxis = -1;
+	for (int a = 0; a < 3; a++)
+	{
+		const float lo = cmin.cell[a], extent = cmax.cell[a] - lo;
+		if (extent <= 0) continue;
+		float3 bmin[BINS], bmax[BINS];
+		int count[BINS] = {};
+		for (int b = 0; b < BINS; b++) bmin[b] = float3( 1e30f ), bmax[b] = float3( -1e30f );
+		for (uint i = 0; i < node.count; i++)
+		{
+			const Instance& instance = instances[instanceIdx[first + i]];
+			const float c = (instance.bmin.cell[a] + instance.bmax.cell[a]) * 0.5f;
+			const int b = min( BINS - 1, (int)((c - lo) * BINS / extent) );
+			bmin[b] = fminf( bmin[b], instance.bmin ), bmax[b] = fmaxf( bmax[b], instance.bmax ), count[b]++;
+		}
+		// sweep from both sides to evaluate the BINS - 1 split planes
+		float leftArea[BINS - 1], rightArea[BINS - 1];
+		int leftCount[BINS - 1], rightCount[BINS - 1];
+		float3 lmin( 1e30f ), lmax( -1e30f ), rmin( 1e30f ), rmax( -1e30f );
+		for (int b = 0, l = 0, r = 0; b < BINS - 1; b++)
+		{
+			lmin = fminf( lmin, bmin[b] ), lmax = fmaxf( lmax, bmax[b] ), l += count[b];
+			const float3 le = lmax - lmin;
+			leftCount[b] = l, leftArea[b] = l ? le.x * le.y + le.y * le.z + le.z * le.x : 0;
+			rmin = fminf( rmin, bmin[BINS - 1 - b] ), rmax = fmaxf( rmax, bmax[BINS - 1 - b] ), r += count[BINS - 1 - b];
+			const float3 re = rmax - rmin;
+			rightCount[BINS - 2 - b] = r, rightArea[BINS - 2 - b] = r ? re.x * re.y + re.y * re.z + re.z * re.x : 0;
+		}
+		for (int b = 0; b < BINS - 1; b++)
+		{
+			const float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+			if (cost < bestCost) bestCost = cost, bestAxis = a, bestSplit = lo + extent * (b + 1) / BINS;
+		}
+	}
+	const float3 e = node.bmax - node.bmin;
+	if (bestAxis == -1 || bestCost >= node.count * (e.x * e.y + e.y * e.z + e.z * e.x)) return;
+	// partition the instance indices
+	int i = first, j = first + node.count - 1;
+	while (i <= j)
+	{
+		const Instance& instance = instances[instanceIdx[i]];
+		if ((instance.bmin.cell[bestAxis] + instance.bmax.cell[bestAxis]) * 0.5f < bestSplit) i++;
+		else swap( instanceIdx[i], instanceIdx[j--] );
+	}
+	const uint leftCount = i - first;
+	if (leftCount == 0 || leftCount == node.count) return;
+	const uint left = nodesUsed;
+	nodesUsed += 2;
+	nodes[left].leftFirst = first, nodes[left].count = leftCount;
+	nodes[left + 1].leftFirst = i, nodes[left + 1].count = node.count - leftCount;
+	node.leftFirst = left, node.count = 0;
+	UpdateBounds( left );
+	UpdateBounds( left + 1 );
+	Subdivide( left, depth + 1 );
+	Subdivide( left + 1, depth + 1 );
+}
+
+void TopLevelBVH::Build()
+{
+	dirty = false;
+	nodes.clear();
+	const uint N = Count();
+	if (N == 0) return;
+	instanceIdx.resize( N );
+	for (uint i = 0; i < N; i++) instanceIdx[i] = i;
+	nodes.resize( 2 * N );
+	nodes[0].leftFirst = 0, nodes[0].count = N, nodesUsed = 1;
+	UpdateBounds( 0 );
+	Subdivide( 0, 0 );
+	nodes.resize( nodesUsed );
+	moved = false, builtCost = 0;
+	for (const Node& node : nodes)
+	{
+		const float3 e = node.bmax - node.bmin;
+		builtCost += e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+}
+
+void TopLevelBVH::Refit()
+{
+	// children are always stored after their parent, so a reverse sweep
+	// visits both children of a node before the node itself
+	moved = false;
+	float cost = 0;
+	for (int i = (int)nodes.size() - 1; i >= 0; i--)
+	{
+		Node& node = nodes[i];
+		if (node.count) UpdateBounds( i ); else
+		{
+			const Node& left = nodes[node.leftFirst], & right = nodes[node.leftFirst + 1];
+			node.bmin = fminf( left.bmin, right.bmin ), node.bmax = fmaxf( left.bmax, right.bmax );
+		}
+		const float3 e = node.bmax - node.bmin;
+		cost += e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+	// refitted nodes overlap more and more as instances move apart
+	if (cost > 2 * builtCost) dirty = true;
+}
+
+static inline float IntersectNode( const TopLevelBVH::Node& node, const Ray& ray )
+{
+	// slab test; returns 1e30f for a miss or a hit beyond ray.t
+	const float3 t1 = (node.bmin - ray.O) * ray.rD, t2 = (node.bmax - ray.O) * ray.rD;
+	const float3 tnear = fminf( t1, t2 ), tfar = fmaxf( t1, t2 );
+	const float tmin = max( max( tnear.x, tnear.y ), tnear.z ), tmax = min( min( tfar.x, tfar.y ), tfar.z );
+	return tmax >= tmin && tmin < ray.t && tmax > 0 ? tmin : 1e30f;
+}
+
+bool TopLevelBVH::Intersect( const Instance& instance, const Ray& ray, float& t, uint& voxel, uint& axis, float3& N ) const
+{
+	// transform the ray to model space; the inverse of the placement in AddInstance
+	const int3 size = Size( instance );
+	float s = 1 / instance.scale;
+	float3 O, Dm;
+	if (instance.transformed)
+	{
+		// D is not normalized in model space, which leaves distances unchanged
+		O = TransformPosition( ray.O, instance.inverse ), Dm = TransformVector( ray.D, instance.inverse );
+		s = length( Dm );
+	}
+	else
+	{
+		const float3 L = (ray.O - instance.position) * s, D = ray.D * s;
+		O = L, Dm = D;
+		switch (instance.rotation)
+		{
+		case 1: O = float3( L.z, L.y, size.z - L.x ), Dm = float3( D.z, D.y, -D.x ); break;
+		case 2: O = float3( size.x - L.x, L.y, size.z - L.z ), Dm = float3( -D.x, D.y, -D.z ); break;
+		case 3: O = float3( size.x - L.z, L.y, L.x ), Dm = float3( -D.z, D.y, D.x ); break;
+		}
+	}
+	if (instance.table)
+	{
+		// animated: full resolution, through the brick table of the instance
+		if (!animations[instance.model]->FindNearest( instance.table, O, Dm, t, voxel, axis )) return false;
+	}
+	else
+	{
+		// level of detail: the coarsest level whose voxels are no larger than the
+		// footprint of a pixel at the distance of the instance
+		const VoxelModel& model = *models[instance.model];
+		int level = 0;
+		if (lodScale > 0)
+		{
+			const float dist = length( fmaxf( instance.bmin, fminf( instance.bmax, ray.O ) ) - ray.O );
+			for (float f = dist * lodScale * s; f >= 2 && level < model.mips - 1; f *= 0.5f) level++;
+		}
+		if (!model.FindNearest( level, O, Dm, t, voxel, axis )) return false;
+	}
+	if (instance.transformed)
+	{
+		// normals transform with the transposed inverse; the model space normal
+		// of the face is an axis, so this picks a row of the inverse
+		const float* row = instance.inverse.cell + axis * 4;
+		N = normalize( float3( row[0], row[1], row[2] ) ) * (Dm.cell[axis] > 0 ? -1.0f : 1.0f), axis = 3;
+	}
+	// odd quarter turns swap the x and z axes
+	else if ((instance.rotation & 1) && axis != 1) axis = 2 - axis;
+	return true;
+}
+
+void TopLevelBVH::FindNearest( Ray& ray ) const
+{
+	// front to back traversal; hits shorten ray.t, which culls further nodes
+	if (nodes.empty() || IntersectNode( nodes[0], ray ) == 1e30f) return;
+	const Node* node = &nodes[0], * stack[64];
+	uint stackPtr = 0;
+	while (1)
+	{
+		if (node->count)
+		{
+			for (uint i = 0; i < node->count; i++)
+			{
+				float t = ray.t;
+				uint voxel, axis;
+				float3 N;
+				if (Intersect( instances[instanceIdx[node->leftFirst + i]], ray, t, voxel, axis, N ))
+					ray.t = t, ray.voxel = voxel, ray.axis = axis, ray.N = N, ray.inside = false;
+			}
+			if (stackPtr == 0) break;
+			node = stack[--stackPtr];
+			continue;
+		}
+		const Node* child1 = &nodes[node->leftFirst], * child2 = child1 + 1;
+		float dist1 = IntersectNode( *child1, ray ), dist2 = IntersectNode( *child2, ray );
+		if (dist1 > dist2) swap( dist1, dist2 ), swap( child1, child2 );
+		if (dist1 == 1e30f)
+		{
+			if (stackPtr == 0) break;
+			node = stack[--stackPtr];
+		}
+		else
+		{
+			node = child1;
+			if (dist2 != 1e30f) stack[stackPtr++] = child2;
+		}
+	}
+}
+
+bool TopLevelBVH::IsOccluded( const Ray& ray ) const
+{
+	// any hit closer than ray.t will do
+	if (nodes.empty() || IntersectNode( nodes[0], ray ) == 1e30f) return false;
+	const Node* node = &nodes[0], * stack[64];
+	uint stackPtr = 0;
+	while (1)
+	{
+		if (node->count)
+		{
+			for (uint i = 0; i < node->count; i++)
+			{
+				float t = ray.t;
+				uint voxel, axis;
+				float3 N;
+				if (Intersect( instances[instanceIdx[node->leftFirst + i]], ray, t, voxel, axis, N )) return true;
+			}
+			if (stackPtr == 0) return false;
+			node = stack[--stackPtr];
+			continue;
+		}
+		const Node* child1 = &nodes[node->leftFirst], * child2 = child1 + 1;
+		const bool hit1 = IntersectNode( *child1, ray ) != 1e30f, hit2 = IntersectNode( *child2, ray ) != 1e30f;
+		if (hit1 && hit2) stack[stackPtr++] = child2;
+		if (hit1 || hit2) node = hit1 ? child1 : child2;
+		else if (stackPtr == 0) return false;
+		else node = stack[--stackPtr];
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#define MAXMODELMIPS	8
+
+namespace Tmpl8 {
+
+class AnimatedModel;
+
+// VoxelModel: a voxel model with its own dense grid, shared by all of its
+// instances. Model space is measured in voxels: the model spans [0, size).
+// Load also builds a mip chain: a voxel of level l covers 2^l voxels along each
+// axis, and is solid if any voxel it covers is solid, so coarse levels never
+// have holes where the model has none. Its colour is the average of the solid
+// voxels it covers; material and emission are those of the majority.
+class VoxelModel
+{
+public:
+	struct Mip
+	{
+		int3 size;				// (size of the level below + 1) / 2
+		uint* voxels;			// x + y * size.x + z * size.x * size.y
+	};
+	VoxelModel() = default;
+	~VoxelModel();
+	bool Load( const char* file );
+	void Create( const int3 dim, const uint* data );
+	bool FindNearest( const int level, const float3& O, const float3& D, float& t, uint& voxel, uint& axis ) const;
+	// data members
+	int3 size = make_int3( 0 );
+	uint* voxels = 0;			// level 0; same as mip[0].voxels
+	Mip mip[MAXMODELMIPS] = {};
+	int mips = 0;
+private:
+	void BuildMips();
+};
+
+// Instance: placement of a model in the world. The model is rotated by a
+// number of quarter turns around the y-axis (as in Scene::LoadModel), scaled
+// to world units and moved to 'position', its minimum corner in the world.
+// Axis-aligned rotations keep model faces axis-aligned, so a hit can be
+// reported with the usual axis / Dsign normal encoding of Ray.
+// An animated instance plays an AnimatedModel: it has a brick table of its own,
+// for the frame it shows.
+// A transformed instance is placed with an arbitrary affine transform instead,
+// such as a vehicle at any angle. Rays are taken to model space once per
+// instance, where the slab test against the model box is an OBB test, and
+// the DDA runs as usual. Its faces are not axis-aligned in world space, so a
+// hit reports its normal in Ray::N, with axis 3.
+struct Instance
+{
+	float3 position;
+	float scale;				// world units per model voxel
+	uint model;					// index in TopLevelBVH::models, or animations if animated
+	int rotation;				// quarter turns around y
+	float3 bmin, bmax;			// world space bounds, set by TopLevelBVH
+	uint* table = 0;			// animated: brick ids of the current frame; 0 otherwise
+	uint frame = 0;				// animated: current frame
+	bool transformed = false;	// placed with SetTransform; position and rotation are unused
+	mat4 inverse;				// transformed: world space to model space
+};
+
+// TopLevelBVH: models, their instances, and a BVH over the instance bounds.
+// A ray is intersected with the BVH in world space; at the leaves it is
+// transformed to the model space of each instance and traversed with a DDA
+// over the model's grid. Ray distances are the same in both spaces, so hits
+// in different instances can be compared directly. Memory use is that of the
+// models plus one record per instance.
+// Distant instances are traversed at a coarser mip level: the level is chosen
+// per ray and instance such that a model voxel covers about 'lodScale' world
+// units per unit of distance, i.e. roughly a pixel when lodScale is the angle
+// of a pixel. A lodScale of 0 always uses the full resolution.
+// Moving instances, such as sprites, are placed anew with Move every frame.
+// Refit then updates the node bounds bottom-up, without changing the tree;
+// this is linear in the number of nodes. When the tree has degraded too far
+// from the one Build made, Refit requests a rebuild by setting 'dirty'.
+// Animated instances play an AnimatedModel; NextFrame and SetFrame patch
+// the brick table of the instance, and leave the BVH as it is.
+class TopLevelBVH
+{
+public:
+	struct Node
+	{
+		float3 bmin;
+		uint leftFirst;			// first child for interior nodes, first instance for leaves
+		float3 bmax;
+		uint count;				// number of instances; 0 for interior nodes
+	};
+	~TopLevelBVH();
+	uint AddModel( const char* file );
+	uint AddModel( VoxelModel* model );
+	uint AddInstance( const uint model, const float3& position, const int rotation = 0, const float scale = 1 );
+	uint AddInstance( const uint model, const mat4& transform );
+	uint AddAnimation( AnimatedModel* animation );
+	uint AddAnimatedInstance( const uint animation, const float3& position, const int rotation = 0, const float scale = 1 );
+	void SetFrame( const uint instance, const uint frame );
+	void NextFrame( const uint instance );
+	void Move( const uint instance, const float3& position, const int rotation = 0 );
+	void SetTransform( const uint instance, const mat4& transform );
+	void Build();
+	void Refit();
+	void FindNearest( Ray& ray ) const;
+	bool IsOccluded( const Ray& ray ) const;
+	uint Count() const { return (uint)instances.size(); }
+	// data members
+	vector<VoxelModel*> models;
+	vector<AnimatedModel*> animations;
+	vector<Instance> instances;
+	vector<uint> instanceIdx;	// instance indices, in leaf order
+	vector<Node> nodes;
+	bool dirty = false;			// instances were added since the last Build
+	bool moved = false;			// instances were moved since the last Build or Refit
+	float lodScale = 0;			// level of detail selection, see above
+private:
+	uint nodesUsed = 0;
+	float builtCost = 0;		// summed node areas after Build
+	int3 Size( const Instance& instance ) const;
+	void UpdateBounds( const uint node );
+	void Subdivide( const uint node, const int depth );
+	bool Intersect( const Instance& instance, const Ray& ray, float& t, uint& voxel, uint& axis, float3& N ) const;
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,108 @@
+#include "template.h"
+
+#define EMPTY	0xffffffffu
+#define ANCHORED	-1
+#define UNSEEN	-2
+
+uint IslandFinder::Root( uint i )
+{
+	// path halving
+	while (parent[i] != i) i = parent[i] = parent[parent[i]];
+	return i;
+}
+
+void IslandFinder::Join( const uint a, const uint b )
+{
+	// the smaller index becomes the root, so labels do not depend on the order of joins
+	const uint ra = Root( a ), rb = Root( b );
+	if (ra < rb) parent[rb] = ra; else if (rb < ra) parent[ra] = rb;
+}
+
+void IslandFinder::Find( const Scene& scene, const int3 bmin, const int3 bmax, vector<Island>& islands )
+{
+	islands.clear();
+	// grow the box by the margin and round it outward to whole bricks
+	const int3 g0 = max( bmin - margin, make_int3( 0 ) ), g1 = min( bmax + margin + BRICKDIM - 1, make_int3( GRIDSIZE ) );
+	lo = make_int3( g0.x / BRICKDIM, g0.y / BRICKDIM, g0.z / BRICKDIM ) * BRICKDIM;
+	hi = make_int3( g1.x / BRICKDIM, g1.y / BRICKDIM, g1.z / BRICKDIM ) * BRICKDIM;
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+	const int3 size = hi - lo, bricks = make_int3( size.x / BRICKDIM, size.y / BRICKDIM, size.z / BRICKDIM );
+	const int sx = size.x, sxy = size.x * size.y, count = sxy * size.z;
+	parent.resize( count );
+	// label each brick on its own; joins stay within the brick, so bricks do
+	// not touch each other's part of the union-find
+	const int brickCount = bricks.x * bricks.y * bricks.z;
+#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < brickCount; b++)
+	{
+		const int3 p = make_int3( b % bricks.x, (b / bricks.x) % bricks.y, b / (bricks.x * bricks.y) ) * BRICKDIM;
+		for (int z = p.z; z < p.z + BRICKDIM; z++) for (int y = p.y; y < p.y + BRICKDIM; y++) for (int x = p.x; x < p.x + BRICKDIM; x++)
+		{
+			const uint i = x + y * sx + z * sxy;
+			if (!scene.grid[lo.x + x + (lo.y + y) * GRIDSIZE + (lo.z + z) * GRIDSIZE2]) { parent[i] = EMPTY; continue; }
+			// a voxel continues the run of solid voxels to its left, if any
+			parent[i] = x > p.x && parent[i - 1] != EMPTY ? parent[i - 1] : i;
+			if (y > p.y && parent[i - sx] != EMPTY) Join( i, i - sx );
+			if (z > p.z && parent[i - sxy] != EMPTY) Join( i, i - sxy );
+		}
+	}
+	// join the labels across brick faces: the first voxel layer of each brick
+	// with the last one of the brick before it, along each axis
+	for (int z = 0; z < size.z; z++) for (int y = 0; y < size.y; y++)
+	{
+		const uint row = y * sx + z * sxy;
+		for (int x = BRICKDIM; x < size.x; x += BRICKDIM)
+			if (parent[row + x] != EMPTY && parent[row + x - 1] != EMPTY) Join( row + x, row + x - 1 );
+		if (y > 0 && (y & (BRICKDIM - 1)) == 0) for (int x = 0; x < size.x; x++)
+			if (parent[row + x] != EMPTY && parent[row + x - sx] != EMPTY) Join( row + x, row + x - sx );
+		if (z > 0 && (z & (BRICKDIM - 1)) == 0) for (int x = 0; x < size.x; x++)
+			if (parent[row + x] != EMPTY && parent[row + x - sxy] != EMPTY) Join( row + x, row + x - sxy );
+	}
+	// anchor the components that reach the edge of the region; the top of the
+	// world is the only edge beyond which nothing can hold a component
+	island.assign( count, UNSEEN );
+	const int top = hi.y < GRIDSIZE ? size.y - 1 : -1;
+	for (int z = 0; z < size.z; z++) for (int y = 0; y < size.y; y++)
+	{
+		const bool face = z == 0 || z == size.z - 1 || y == 0 || y == top;
+		const uint row = y * sx + z * sxy;
+		for (int x = 0; x < size.x; x += face ? 1 : size.x - 1)
+			if (parent[row + x] != EMPTY) island[Root( row + x )] = ANCHORED;
+	}
+	// the remaining components are islands
+	for (int z = 0; z < size.z; z++) for (int y = 0; y < size.y; y++) for (int x = 0; x < size.x; x++)
+	{
+		const uint i = x + y * sx + z * sxy;
+		if (parent[i] == EMPTY) continue;
+		int& idx = island[Root( i )];
+		if (idx == ANCHORED) continue;
+		if (idx == UNSEEN)
+		{
+			idx = (int)islands.size();
+			islands.push_back( { make_int3( GRIDSIZE ), make_int3( 0 ), {} } );
+		}
+		Island& isle = islands[idx];
+		const int3 v = lo + make_int3( x, y, z );
+		isle.bmin = min( isle.bmin, v ), isle.bmax = max( isle.bmax, v + 1 );
+		isle.voxels.push_back( v.x + v.y * GRIDSIZE + v.z * GRIDSIZE2 );
+	}
+}
+
+uint IslandFinder::Detach( Scene& scene, const Island& island )
+{
+	// move the voxels of an island to a model of its own, placed where the
+	// voxels were; returns the new instance
+	const int3 size = island.bmax - island.bmin;
+	vector<uint> voxels( (size_t)size.x * size.y * size.z, 0 );
+	for (const uint i : island.voxels)
+	{
+		const int3 v = make_int3( i % GRIDSIZE, (i / GRIDSIZE) % GRIDSIZE, i / GRIDSIZE2 ) - island.bmin;
+		voxels[v.x + v.y * size.x + v.z * size.x * size.y] = scene.grid[i];
+		scene.grid[i] = 0;
+	}
+	scene.MarkDirty( island.bmin, island.bmax );
+	VoxelModel* model = new VoxelModel();
+	model->Create( size, voxels.data() );
+	const uint idx = scene.instances.AddModel( model );
+	return scene.instances.AddInstance( idx, make_float3( island.bmin ) * (1.0f / GRIDSIZE) );
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+namespace Tmpl8 {
+
+// IslandFinder: finds voxels that lost their connection to the ground in an
+// edit, such as an explosion, so that they can fall as dynamic objects.
+// Find examines the edited box, grown by 'margin' voxels and aligned to
+// bricks. Solid voxels connect through their faces. Each brick is labelled on
+// its own, in parallel, with a union-find over the voxels of the region; the
+// labels are then joined across brick faces. A component that reaches the
+// edge of the region may continue outside it and counts as anchored, as does
+// one that reaches the bottom or the sides of the world. The other components
+// are reported as islands. Islands larger than the region are never found, so
+// the margin trades the size of the islands that can be found for time.
+// Detach moves an island from the grid into a new instanced model.
+class IslandFinder
+{
+public:
+	struct Island
+	{
+		int3 bmin, bmax;		// bounds in voxels; bmax is exclusive
+		vector<uint> voxels;	// grid indices
+	};
+	void Find( const Scene& scene, const int3 bmin, const int3 bmax, vector<Island>& islands );
+	static uint Detach( Scene& scene, const Island& island );
+	int margin = 16;			// in voxels
+private:
+	uint Root( uint i );
+	void Join( const uint a, const uint b );
+	vector<uint> parent;		// per voxel of the region; EMPTY for empty voxels
+	vector<int> island;			// per root: index in the islands, -1 if anchored
+	int3 lo, hi;				// region, in voxels
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,266 @@
+#include "template.h"
+
+static inline uint BrickOrigin( const uint brick )
+{
+	// grid index of the first voxel of a brick
+	return (brick % GRIDBRICKS) * BRICKDIM + ((brick / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM * GRIDSIZE + (brick / GRIDBRICKS2) * BRICKDIM * GRIDSIZE2;
+}
+
+void EditJournal::Reset( const Scene& scene )
+{
+	// start a new log from the current world
+	if (!shadow) shadow = (uint*)MALLOC64( GRIDSIZE3 * sizeof( uint ) );
+	memcpy( shadow, scene.grid, GRIDSIZE3 * sizeof( uint ) );
+	Clear();
+}
+
+bool EditJournal::Open( const char* name, Scene& scene )
+{
+	// continue the journal file of a restored world: replay the frames in it
+	// that follow the current stamp, then start the file over with the log.
+	// Frames of an older base are skipped; a damaged tail or the frames of a
+	// later base, whose snapshot was lost, end the replay. A world that was
+	// not restored, see Restore, starts with an empty journal file.
+	Close();
+	const bool restored = shadow != 0;
+	if (!restored) Reset( scene );
+	const uint since = frame;
+	MappedFile mapped;
+	if (restored && mapped.Open( name )) for (size_t pos = 0; pos + sizeof( uint ) <= mapped.size;)
+	{
+		uint bytes;
+		memcpy( &bytes, mapped.data + pos, sizeof( uint ) );
+		pos += sizeof( uint );
+		if (bytes > mapped.size - pos || !Deserialize( mapped.data + pos, bytes )) break;
+		pos += bytes;
+	}
+	mapped.Close();
+	Replay( scene, since );
+	fileName = name, written = base;
+	file = fopen( name, "wb" );
+	Append();
+	return file != 0;
+}
+
+void EditJournal::Close()
+{
+	if (file) fclose( file );
+	file = 0;
+}
+
+void EditJournal::Append()
+{
+	// write the frames that are not in the journal file yet, as one chunk
+	if (!file || frames.empty() || frames.back().stamp <= written) return;
+	vector<uchar> data;
+	Serialize( data, written );
+	const uint bytes = (uint)data.size();
+	fwrite( &bytes, sizeof( uint ), 1, file );
+	fwrite( data.data(), 1, bytes, file );
+	fflush( file );
+	written = frame;
+}
+
+uint EditJournal::EncodeBrick( const uint* grid, const uint brick, Run* out ) const
+{
+	// runs of changed voxels with equal values; without 'out', runs are only counted
+	const uint origin = BrickOrigin( brick );
+	uint count = 0, value = 0;
+	bool open = false;
+	for (int row = 0; row < BRICKDIM * BRICKDIM; row++)
+	{
+		const uint offset = origin + (row % BRICKDIM) * GRIDSIZE + (row / BRICKDIM) * GRIDSIZE2;
+		const __m256i a = _mm256_load_si256( (const __m256i*)(grid + offset) );
+		const __m256i b = _mm256_load_si256( (const __m256i*)(shadow + offset) );
+		const uint same = _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpeq_epi32( a, b ) ) );
+		if (same == 255) { open = false; continue; }
+		for (int x = 0; x < BRICKDIM; x++)
+		{
+			if (same & (1 << x)) { open = false; continue; }
+			const uint v = grid[offset + x];
+			if (open && v == value) { if (out) out[count - 1].count++; continue; }
+			if (out) out[count] = { (ushort)(row * BRICKDIM + x), 1, v };
+			count++, value = v, open = true;
+		}
+	}
+	return count;
+}
+
+void EditJournal::Record( const Scene& scene )
+{
+	// the first frame recorded is the start of the log, unless Reset was called
+	frame++;
+	if (!shadow) { Reset( scene ); return; }
+	if (!scene.edited) return;
+	// count the runs of the dirty bricks, then encode them in place
+	const int dirtyCount = (int)scene.dirtyBricks.size();
+	counts.resize( dirtyCount );
+#pragma omp parallel for schedule(dynamic, 16)
+	for (int i = 0; i < dirtyCount; i++) counts[i] = EncodeBrick( scene.grid, scene.dirtyBricks[i], 0 );
+	Frame f = { frame, (uint)changes.size(), 0 };
+	for (int i = 0; i < dirtyCount; i++) if (counts[i])
+	{
+		changes.push_back( { scene.dirtyBricks[i], (uint)runs.size(), counts[i] } );
+		runs.resize( runs.size() + counts[i] );
+		f.count++;
+	}
+	if (f.count == 0) return; // dirty, but unchanged
+	frames.push_back( f );
+#pragma omp parallel for schedule(dynamic, 16)
+	for (int i = 0; i < (int)f.count; i++)
+	{
+		const Change& r = changes[f.first + i];
+		EncodeBrick( scene.grid, r.brick, runs.data() + r.first );
+		// the shadow follows the grid
+		const uint origin = BrickOrigin( r.brick );
+		for (int row = 0; row < BRICKDIM * BRICKDIM; row++)
+		{
+			const uint offset = origin + (row % BRICKDIM) * GRIDSIZE + (row / BRICKDIM) * GRIDSIZE2;
+			memcpy( shadow + offset, scene.grid + offset, BRICKDIM * sizeof( uint ) );
+		}
+	}
+	Append();
+}
+
+void EditJournal::Replay( Scene& scene, const uint since )
+{
+	// apply the frames after 'since' to the world and the shadow, if any, so
+	// that they are not recorded again. Changes are grouped per brick, in log order;
+	// bricks are then independent, and are written in parallel.
+	size_t f = frames.size();
+	while (f > 0 && frames[f - 1].stamp > since) f--;
+	if (f == frames.size()) return;
+	const uint first = frames[f].first, count = (uint)changes.size() - first;
+	vector<uint64_t> order( count );
+	for (uint i = 0; i < count; i++) order[i] = ((uint64_t)changes[first + i].brick << 32) + first + i;
+	sort( order.begin(), order.end() );
+	vector<uint> groups;
+	for (uint i = 0; i < count; i++) if (i == 0 || (order[i] >> 32) != (order[i - 1] >> 32)) groups.push_back( i );
+	groups.push_back( count );
+#pragma omp parallel for schedule(dynamic, 16)
+	for (int g = 0; g < (int)groups.size() - 1; g++)
+	{
+		const uint brick = (uint)(order[groups[g]] >> 32);
+		const uint origin = BrickOrigin( brick );
+		for (uint i = groups[g]; i < groups[g + 1]; i++)
+		{
+			const Change& r = changes[(uint)order[i]];
+			for (uint j = r.first; j < r.first + r.count; j++)
+			{
+				const Run& run = runs[j];
+				for (uint k = run.start; k < (uint)run.start + run.count; k++)
+				{
+					const uint idx = origin + (k % BRICKDIM) + ((k / BRICKDIM) % BRICKDIM) * GRIDSIZE + (k / (BRICKDIM * BRICKDIM)) * GRIDSIZE2;
+					scene.grid[idx] = run.value;
+					if (shadow) shadow[idx] = run.value;
+				}
+			}
+		}
+	}
+	for (uint g = 0; g < (uint)groups.size() - 1; g++) scene.MarkDirty( (uint)(order[groups[g]] >> 32) );
+}
+
+void EditJournal::Serialize( vector<uchar>& data, const uint since ) const
+{
+	// a header, followed by the frames after 'since', their changes and their
+	// runs; offsets are relative to the first frame in the buffer
+	size_t f = frames.size();
+	while (f > 0 && frames[f - 1].stamp > since) f--;
+	const uint firstChange = f < frames.size() ? frames[f].first : (uint)changes.size();
+	const uint firstRun = firstChange < changes.size() ? changes[firstChange].first : (uint)runs.size();
+	const Header header = { max( since, base ), frame, (uint)(frames.size() - f), (uint)changes.size() - firstChange, (uint)runs.size() - firstRun, 0 };
+	data.resize( sizeof( Header ) + header.frames * sizeof( Frame ) + header.changes * sizeof( Change ) + header.runs * sizeof( Run ) );
+	uchar* p = data.data();
+	memcpy( p, &header, sizeof( Header ) ), p += sizeof( Header );
+	for (size_t i = f; i < frames.size(); i++, p += sizeof( Frame ))
+	{
+		const Frame rebased = { frames[i].stamp, frames[i].first - firstChange, frames[i].count };
+		memcpy( p, &rebased, sizeof( Frame ) );
+	}
+	for (size_t i = firstChange; i < changes.size(); i++, p += sizeof( Change ))
+	{
+		const Change rebased = { changes[i].brick, changes[i].first - firstRun, changes[i].count };
+		memcpy( p, &rebased, sizeof( Change ) );
+	}
+	if (header.runs) memcpy( p, runs.data() + firstRun, header.runs * sizeof( Run ) );
+}
+
+bool EditJournal::Deserialize( const uchar* data, const size_t bytes )
+{
+	// append the frames of a serialized journal that are newer than the log;
+	// fails if the buffer is damaged or starts after the end of the log
+	if (bytes < sizeof( Header )) return false;
+	Header header;
+	memcpy( &header, data, sizeof( Header ) );
+	const Frame* f = (const Frame*)(data + sizeof( Header ));
+	const Change* r = (const Change*)(f + header.frames);
+	const Run* s = (const Run*)(r + header.changes);
+	if (bytes != sizeof( Header ) + (uint64_t)header.frames * sizeof( Frame ) + (uint64_t)header.changes * sizeof( Change ) + (uint64_t)header.runs * sizeof( Run )) return false;
+	if (header.base > frame) return false;
+	// validate everything before the log is touched
+	uint nextChange = 0, nextRun = 0, stamp = header.base;
+	for (uint i = 0; i < header.frames; i++)
+	{
+		if (f[i].stamp <= stamp || f[i].stamp > header.frame || f[i].first != nextChange || f[i].count > header.changes - nextChange) return false;
+		stamp = f[i].stamp, nextChange += f[i].count;
+	}
+	for (uint i = 0; i < header.changes; i++)
+	{
+		if (r[i].brick >= BRICKCOUNT || r[i].first != nextRun || r[i].count > header.runs - nextRun) return false;
+		nextRun += r[i].count;
+	}
+	if (nextChange != header.changes || nextRun != header.runs) return false;
+	for (uint i = 0; i < header.runs; i++) if ((uint)s[i].start + s[i].count > BRICKSIZE) return false;
+	for (uint i = 0; i < header.frames; i++) if (f[i].stamp > frame)
+	{
+		frames.push_back( { f[i].stamp, (uint)changes.size(), f[i].count } );
+		for (uint j = f[i].first; j < f[i].first + f[i].count; j++)
+		{
+			changes.push_back( { r[j].brick, (uint)runs.size(), r[j].count } );
+			runs.insert( runs.end(), s + r[j].first, s + r[j].first + r[j].count );
+		}
+	}
+	frame = max( frame, header.frame );
+	return true;
+}
+
+void EditJournal::Compact( Snapshot& snapshot, const Scene& scene )
+{
+	// write the world and an empty log that starts from it; edits that were not
+	// recorded yet are taken in first. The journal file is kept until the
+	// snapshot is committed, see Truncate: Open skips the frames it has.
+	Record( scene );
+	snapshot.BeginSection( SECTION_VOXELS, 1 );
+	SceneFile::Write( snapshot.file, shadow );
+	snapshot.EndSection();
+	Clear();
+	vector<uchar> data;
+	Serialize( data, base );
+	snapshot.BeginSection( SECTION_JOURNAL, 1 );
+	snapshot.Write( data.data(), data.size() );
+	snapshot.EndSection();
+	written = frame;
+}
+
+void EditJournal::Truncate()
+{
+	// start the journal file over, after the snapshot of Compact was committed
+	if (file) fclose( file ), file = fopen( fileName.c_str(), "wb" );
+}
+
+bool EditJournal::Restore( Snapshot& snapshot, Scene& scene )
+{
+	// continue from a snapshot whose voxels were just loaded into the world;
+	// its edits after that are in the journal file, see Open
+	uint version;
+	Header header;
+	const bool found = snapshot.FindSection( SECTION_JOURNAL, version ) && version == 1 && snapshot.Read( header );
+	if (found) frame = header.base;
+	Reset( scene );
+	return found;
+}
+
+size_t EditJournal::LogSize() const
+{
+	return frames.size() * sizeof( Frame ) + changes.size() * sizeof( Change ) + runs.size() * sizeof( Run );
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#define SECTION_JOURNAL		0x4c4e524a	// 'JRNL'
+
+// a log that passes either limit is due for compaction, see EditJournal::Full
+#define JOURNAL_MAXBYTES	(64 << 20)
+#define JOURNAL_MAXFRAMES	(60 * 60 * 10)	// ten minutes of edits at 60fps
+
+namespace Tmpl8 {
+
+// EditJournal: a log of the changes to the voxel grid, stamped with frames.
+// Record is called once per frame, before Scene::ClearDirty. It compares the
+// dirty bricks against a shadow copy of the grid, so every edit that marks
+// its bricks dirty is captured: Scene::Set, the bulk edits, loaded models,
+// the automaton and edits from other threads alike. Changed voxels are stored
+// per brick as runs of equal values, in x, y, z order within the brick;
+// unchanged voxels between runs are skipped. A frame without changes takes no
+// space, only its stamp is used.
+// Replay applies the frames after a given stamp, one brick per task. Serialize
+// and Deserialize turn a range of frames into a flat buffer and back, for
+// files and for other processes that hold the same world.
+// A session is kept in two files: a snapshot with the world as of the last
+// compaction, and a journal file, to which Record appends each frame with
+// edits. Open replays the journal file after the snapshot was restored.
+// Compact writes the world to a new snapshot and empties the log; once the
+// snapshot is committed, Truncate starts the journal file over. A crash in
+// between leaves the new snapshot with the old journal file, whose frames are
+// then skipped. The log is kept in memory until Compact, for replication; the
+// owner compacts when Full reports that the log has grown too large.
+// A journal that is never Reset has no shadow; it can still Deserialize and
+// Replay frames, which is all a replica needs, see ReplicationClient.
+// Instances are not journaled.
+class EditJournal
+{
+public:
+	struct Run
+	{
+		ushort start, count;	// voxels, in brick order
+		uint value;
+	};
+	struct Change { uint brick, first, count; };	// a changed brick; runs [first, first + count)
+	struct Frame { uint stamp, first, count; };		// changes [first, first + count)
+	struct Header { uint base, frame, frames, changes, runs, dummy; };	// of a serialized journal
+	EditJournal() = default;
+	~EditJournal() { Close(); FREE64( shadow ); }
+	void Reset( const Scene& scene );
+	void Restart( const Scene& scene ) { frame++; Reset( scene ); }	// after changes that were not recorded
+	void Clear() { frames.clear(), changes.clear(), runs.clear(); base = frame; }	// drop the log, keep the stamp
+	bool Open( const char* fileName, Scene& scene );
+	void Close();
+	void Record( const Scene& scene );
+	void Replay( Scene& scene, const uint since );
+	void Serialize( vector<uchar>& data, const uint since ) const;
+	bool Deserialize( const uchar* data, const size_t bytes );
+	void Compact( Snapshot& snapshot, const Scene& scene );
+	void Truncate();
+	bool Restore( Snapshot& snapshot, Scene& scene );
+	uint Frames() const { return (uint)frames.size(); }	// frames with changes
+	bool Full() const { return frames.size() > JOURNAL_MAXFRAMES || LogSize() > JOURNAL_MAXBYTES; }
+	size_t LogSize() const;		// in bytes; the shadow grid is not included
+	// data members
+	uint base = 0;				// stamp of the world the log starts from
+	uint frame = 0;				// stamp of the last recorded frame
+	vector<Frame> frames;
+	vector<Change> changes;
+	vector<Run> runs;
+private:
+	uint EncodeBrick( const uint* grid, const uint brick, Run* out ) const;
+	void Append();
+	FILE* file = 0;				// journal file, appended to by Record
+	string fileName;
+	uint written = 0;			// stamp of the last frame in the journal file
+	uint* shadow = 0;			// the grid as of 'frame'
+	vector<uint> counts;		// Record: runs per dirty brick
+};
+
+} // namespace Tmpl8
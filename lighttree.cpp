@@ -0,0 +1,143 @@
+#include "template.h"
+
+LightTree::LightTree()
+{
+	// level 0 has a node per brick; each next level halves the resolution
+	for (int s = GRIDBRICKS; s > 0; s >>= 1)
+	{
+		node[levels] = (Node*)MALLOC64( s * s * s * sizeof( Node ) );
+		memset( node[levels++], 0, s * s * s * sizeof( Node ) );
+	}
+	brick = new Brick[BRICKCOUNT];
+}
+
+LightTree::~LightTree()
+{
+	for (int l = 0; l < levels; l++) FREE64( node[l] );
+	delete[] brick;
+}
+
+void LightTree::ScanBrick( const int b )
+{
+	// collect the emitters in a brick and store their bounds in its leaf node
+	const int bx = (b % GRIDBRICKS) * BRICKDIM, by = ((b / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM, bz = (b / GRIDBRICKS2) * BRICKDIM;
+	Brick& list = brick[b];
+	list.voxel.clear();
+	list.cdf.clear();
+	Node& n = node[0][b];
+	n.bmin = float3( 1e34f ), n.bmax = float3( -1e34f ), n.power = 0;
+	for (int z = bz; z < bz + BRICKDIM; z++) for (int y = by; y < by + BRICKDIM; y++)
+	{
+		const uint* line = grid + bx + y * GRIDSIZE + z * GRIDSIZE2;
+		for (int x = 0; x < BRICKDIM; x++) if (line[x] & EMISSIVE)
+		{
+			const float3 Le = RGB8_to_RGBF32( line[x] ) * EMISSION_SCALE;
+			const float power = 0.2126f * Le.x + 0.7152f * Le.y + 0.0722f * Le.z;
+			if (power <= 0) continue;
+			const float3 P = float3( (float)(bx + x), (float)y, (float)z ) * (1.0f / GRIDSIZE);
+			n.bmin = fminf( n.bmin, P ), n.bmax = fmaxf( n.bmax, P + 1.0f / GRIDSIZE );
+			n.power += power;
+			list.voxel.push_back( bx + x + y * GRIDSIZE + z * GRIDSIZE2 );
+			list.cdf.push_back( n.power );
+		}
+	}
+	n.count = (uint)list.voxel.size();
+}
+
+void LightTree::UpdateNode( const int l, const int x, const int y, const int z )
+{
+	// merge the 8 children
+	const int s = GRIDBRICKS >> (l - 1);
+	Node& n = node[l][x + y * (s >> 1) + z * (s >> 1) * (s >> 1)];
+	n.bmin = float3( 1e34f ), n.bmax = float3( -1e34f ), n.power = 0, n.count = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		const Node& c = node[l - 1][(2 * x + (i & 1)) + (2 * y + ((i >> 1) & 1)) * s + (2 * z + (i >> 2)) * s * s];
+		if (!c.count) continue;
+		n.bmin = fminf( n.bmin, c.bmin ), n.bmax = fmaxf( n.bmax, c.bmax );
+		n.power += c.power, n.count += c.count;
+	}
+}
+
+void LightTree::Update( const Scene& scene )
+{
+	grid = scene.grid;
+	if (!scene.edited) return;
+	// rescan the dirty bricks
+	const vector<uint>& bricks = scene.dirtyBricks;
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)bricks.size(); i++) ScanBrick( bricks[i] );
+	// refit their ancestors, level by level
+	vector<int> parents;
+	for (int l = 1; l < levels; l++)
+	{
+		const int s = GRIDBRICKS >> l;
+		parents.clear();
+		for (int b : bricks)
+		{
+			const int x = (b % GRIDBRICKS) >> l, y = ((b / GRIDBRICKS) % GRIDBRICKS) >> l, z = (b / GRIDBRICKS2) >> l;
+			parents.push_back( x + y * s + z * s * s );
+		}
+		sort( parents.begin(), parents.end() );
+		parents.erase( unique( parents.begin(), parents.end() ), parents.end() );
+		for (int p : parents) UpdateNode( l, p % s, (p / s) % s, p / (s * s) );
+	}
+}
+
+float LightTree::Importance( const Node& n, const float3& P )
+{
+	// power over squared distance, clamped to the node size for nearby nodes
+	if (!n.count) return 0;
+	const float3 extent = n.bmax - n.bmin;
+	return n.power / max( sqrLength( (n.bmin + n.bmax) * 0.5f - P ), 0.25f * dot( extent, extent ) );
+}
+
+float3 LightTree::Sample( const float3& P, float3& L, float& dist, float& pdf ) const
+{
+	// pick a brick by descending the tree, then an emitter in proportion to its
+	// power, then a point on one of the emitter's faces that are visible from P.
+	// Returns the emitted radiance; pdf is with respect to solid angle.
+	pdf = 0;
+	if (!Count()) return float3( 0 );
+	int x = 0, y = 0, z = 0;
+	float prob = 1;
+	for (int l = levels - 1; l > 0; l--)
+	{
+		const int s = GRIDBRICKS >> (l - 1);
+		float w[8], sum = 0;
+		for (int i = 0; i < 8; i++)
+		{
+			const int cx = 2 * x + (i & 1), cy = 2 * y + ((i >> 1) & 1), cz = 2 * z + (i >> 2);
+			sum += w[i] = Importance( node[l - 1][cx + cy * s + cz * s * s], P );
+		}
+		if (sum <= 0) return float3( 0 );
+		float r = RandomFloat() * sum;
+		int pick = -1;
+		for (int i = 0; i < 8; i++) if (w[i] > 0)
+		{
+			pick = i;
+			if (r < w[i]) break;
+			r -= w[i];
+		}
+		prob *= w[pick] / sum;
+		x = 2 * x + (pick & 1), y = 2 * y + ((pick >> 1) & 1), z = 2 * z + (pick >> 2);
+	}
+	const Brick& list = brick[x + y * GRIDBRICKS + z * GRIDBRICKS2];
+	const float total = list.cdf.back();
+	const int i = min( (int)(upper_bound( list.cdf.begin(), list.cdf.end(), RandomFloat() * total ) - list.cdf.begin()), (int)list.cdf.size() - 1 );
+	prob *= (list.cdf[i] - (i ? list.cdf[i - 1] : 0)) / total;
+	// choose a visible face in proportion to its projected area
+	const uint idx = list.voxel[i];
+	const float3 C = (float3( (float)(idx % GRIDSIZE), (float)((idx / GRIDSIZE) % GRIDSIZE), (float)(idx / GRIDSIZE2) ) + 0.5f) * (1.0f / GRIDSIZE);
+	const float3 delta = P - C, a = fabs( delta );
+	const float faceSum = a.x + a.y + a.z, r = RandomFloat() * faceSum;
+	const int axis = r < a.x ? 0 : r < a.x + a.y ? 1 : 2;
+	float3 Q = C + float3( RandomFloat() - 0.5f, RandomFloat() - 0.5f, RandomFloat() - 0.5f ) * (1.0f / GRIDSIZE);
+	Q[axis] = C.cell[axis] + (delta.cell[axis] > 0 ? 0.5f : -0.5f) / GRIDSIZE;
+	// convert the area pdf of the point to solid angle
+	L = Q - P, dist = length( L ), L *= 1 / dist;
+	const float cosLight = fabs( L.cell[axis] );
+	if (cosLight <= 0 || faceSum <= 0) return float3( 0 );
+	pdf = prob * (a.cell[axis] / faceSum) * GRIDSIZE2 * dist * dist / cosLight;
+	return RGB8_to_RGBF32( grid[idx] ) * EMISSION_SCALE;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#define MAXLIGHTLEVELS	8
+
+namespace Tmpl8 {
+
+// LightTree: emissive voxels, organized for many-light sampling.
+// Emitters are collected per brick in compact lists with a power cdf. On top
+// of the bricks sits an implicit octree; each node stores the bounds and the
+// summed power of the emitters below it. Sampling descends from the root,
+// picking children in proportion to their estimated contribution to the
+// shading point. Edits rescan only the dirty bricks and refit their ancestors.
+class LightTree
+{
+public:
+	struct Node
+	{
+		float3 bmin;		// bounds of the emitters below this node
+		float power;		// summed luminance, 0 if there are no emitters
+		float3 bmax;
+		uint count;			// number of emitters below this node
+	};
+	struct Brick
+	{
+		vector<uint> voxel;	// grid indices of the emitters in the brick
+		vector<float> cdf;	// running sum of their power
+	};
+	LightTree();
+	~LightTree();
+	void Update( const Scene& scene );
+	float3 Sample( const float3& P, float3& L, float& dist, float& pdf ) const;
+	uint Count() const { return node[levels - 1][0].count; }
+	// data members
+	Node* node[MAXLIGHTLEVELS] = {};	// node[0] has one node per brick; the last level is the root
+	int levels = 0;
+	Brick* brick = 0;
+	const uint* grid = 0;
+private:
+	void ScanBrick( const int b );
+	void UpdateNode( const int l, const int x, const int y, const int z );
+	static float Importance( const Node& n, const float3& P );
+};
+
+} // namespace Tmpl8
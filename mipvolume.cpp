@@ -0,0 +1,141 @@
+#include "template.h"
+
+#define BRICKLEVELS	3 // log2( BRICKDIM ): mip levels that lie entirely inside a brick
+
+MipVolume::MipVolume()
+{
+	// allocate levels 1..n; level n is a single texel
+	for (int s = GRIDSIZE >> 1; s > 0; s >>= 1)
+	{
+		level[++levels] = (uint*)MALLOC64( s * s * s * sizeof( uint ) );
+		memset( level[levels], 0, s * s * s * sizeof( uint ) );
+	}
+}
+
+MipVolume::~MipVolume()
+{
+	for (int l = 1; l <= levels; l++) FREE64( level[l] );
+}
+
+uint MipVolume::Texel( const int l, const int x, const int y, const int z ) const
+{
+	if (l > 0)
+	{
+		const int s = GRIDSIZE >> l;
+		return level[l][x + y * s + z * s * s];
+	}
+	// level 0: a solid voxel has full coverage
+	const uint v = grid[x + y * GRIDSIZE + z * GRIDSIZE2];
+	return v ? (0xff000000 | (v & 0xffffff)) : 0;
+}
+
+void MipVolume::UpdateBlock( const int l, const int x, const int y, const int z )
+{
+	// coverage-weighted average of the 8 children
+	uint coverage = 0, r = 0, g = 0, b = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		const uint t = Texel( l - 1, 2 * x + (i & 1), 2 * y + ((i >> 1) & 1), 2 * z + (i >> 2) ), a = t >> 24;
+		coverage += a, r += ((t >> 16) & 255) * a, g += ((t >> 8) & 255) * a, b += (t & 255) * a;
+	}
+	const int s = GRIDSIZE >> l;
+	level[l][x + y * s + z * s * s] = coverage == 0 ? 0 :
+		(((coverage + 4) >> 3) << 24) + ((r / coverage) << 16) + ((g / coverage) << 8) + (b / coverage);
+}
+
+void MipVolume::Update( const Scene& scene )
+{
+	grid = scene.grid;
+	if (!scene.edited) return;
+	// the dirty bricks, as listed by the scene
+	const vector<uint>& bricks = scene.dirtyBricks;
+	// the first levels lie inside a brick: update the dirty bricks in parallel
+	const int brickLevels = min( levels, BRICKLEVELS );
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)bricks.size(); i++)
+	{
+		const int bx = bricks[i] % GRIDBRICKS, by = (bricks[i] / GRIDBRICKS) % GRIDBRICKS, bz = bricks[i] / GRIDBRICKS2;
+		for (int l = 1; l <= brickLevels; l++)
+		{
+			const int s = BRICKDIM >> l;
+			for (int z = 0; z < s; z++) for (int y = 0; y < s; y++) for (int x = 0; x < s; x++)
+				UpdateBlock( l, bx * s + x, by * s + y, bz * s + z );
+		}
+	}
+	// coarser levels: update the ancestors of the dirty bricks, level by level
+	vector<int> parents;
+	for (int l = brickLevels + 1; l <= levels; l++)
+	{
+		const int shift = l - brickLevels, s = GRIDSIZE >> l;
+		parents.clear();
+		for (int brick : bricks)
+		{
+			const int x = (brick % GRIDBRICKS) >> shift, y = ((brick / GRIDBRICKS) % GRIDBRICKS) >> shift, z = (brick / GRIDBRICKS2) >> shift;
+			parents.push_back( x + y * s + z * s * s );
+		}
+		sort( parents.begin(), parents.end() );
+		parents.erase( unique( parents.begin(), parents.end() ), parents.end() );
+	#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)parents.size(); i++)
+			UpdateBlock( l, parents[i] % s, (parents[i] / s) % s, parents[i] / (s * s) );
+	}
+}
+
+float4 MipVolume::Fetch( const int l, const float3& P ) const
+{
+	// trilinear sample of a level; returns premultiplied albedo and coverage
+	const int s = GRIDSIZE >> l;
+	const float3 p = P * (float)s - 0.5f;
+	const int x0 = (int)floorf( p.x ), y0 = (int)floorf( p.y ), z0 = (int)floorf( p.z );
+	const float fx = p.x - x0, fy = p.y - y0, fz = p.z - z0;
+	float4 sum( 0 );
+	for (int i = 0; i < 8; i++)
+	{
+		const int x = clamp( x0 + (i & 1), 0, s - 1 );
+		const int y = clamp( y0 + ((i >> 1) & 1), 0, s - 1 );
+		const int z = clamp( z0 + (i >> 2), 0, s - 1 );
+		const uint t = Texel( l, x, y, z );
+		if (!t) continue;
+		const float w = (i & 1 ? fx : 1 - fx) * (i & 2 ? fy : 1 - fy) * (i & 4 ? fz : 1 - fz);
+		const float a = (t >> 24) * (1.0f / 255);
+		sum += w * float4( RGB8_to_RGBF32( t ) * a, a );
+	}
+	return sum;
+}
+
+float MipVolume::ConeTrace( const float3& O, const float3& D, const float tanHalfAngle, const float maxDist, float3& color ) const
+{
+	// march the cone front to back, sampling the level that matches its diameter;
+	// steps are half a diameter, so a cone covers the world in a handful of samples.
+	// O should be offset from the surface it leaves, to prevent self-occlusion.
+	const float voxel = 1.0f / GRIDSIZE;
+	float occlusion = 0, dist = voxel;
+	color = float3( 0 );
+	while (dist < maxDist && occlusion < 0.99f)
+	{
+		const float3 P = O + dist * D;
+		if (P.x < 0 || P.y < 0 || P.z < 0 || P.x > 1 || P.y > 1 || P.z > 1) break;
+		const float diameter = max( voxel, 2 * tanHalfAngle * dist );
+		const int l = min( (int)log2f( diameter * GRIDSIZE ), levels );
+		const float4 sample = Fetch( l, P );
+		if (sample.w > 0)
+		{
+			// opacity correction: a sample covers half a texel of cone length
+			const float a = 1 - sqrtf( 1 - min( sample.w, 0.999f ) ), scale = a / sample.w;
+			color += (1 - occlusion) * scale * float3( sample.x, sample.y, sample.z );
+			occlusion += (1 - occlusion) * a;
+		}
+		dist += diameter * 0.5f;
+	}
+	return 1 - occlusion;
+}
+
+float MipVolume::Visibility( const float3& O, const float3& target, const float radius ) const
+{
+	// approximate visibility of a spherical light of the given radius
+	const float3 L = target - O;
+	const float dist = length( L );
+	if (dist <= radius) return 1;
+	float3 unused;
+	return ConeTrace( O, L * (1 / dist), radius / dist, dist - radius, unused );
+}
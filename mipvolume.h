@@ -0,0 +1,32 @@
+#pragma once
+
+#define MAXMIPLEVELS	10
+
+namespace Tmpl8 {
+
+// MipVolume: prefiltered mip chain over the voxel grid, for cone tracing.
+// Level 0 is the scene grid itself; each texel of level n summarizes a 2x2x2
+// block of level n - 1 as 8-bit average albedo (rgb) plus 8-bit coverage (a),
+// i.e. the fraction of solid level-0 voxels in its footprint. A cone query
+// gives approximate visibility or reflected colour in a few samples, as a
+// cheap alternative to IsOccluded for large lights and to FindNearest for
+// rough reflections.
+class MipVolume
+{
+public:
+	MipVolume();
+	~MipVolume();
+	void Update( const Scene& scene );
+	float4 Fetch( const int level, const float3& P ) const;
+	float ConeTrace( const float3& O, const float3& D, const float tanHalfAngle, const float maxDist, float3& color ) const;
+	float Visibility( const float3& O, const float3& target, const float radius ) const;
+	// data members
+	uint* level[MAXMIPLEVELS] = {};	// level[0] is unused; the scene grid is level 0
+	int levels = 0;					// number of mip levels above the grid
+	const uint* grid = 0;
+private:
+	void UpdateBlock( const int l, const int x, const int y, const int z );
+	uint Texel( const int l, const int x, const int y, const int z ) const;
+};
+
+} // namespace Tmpl8
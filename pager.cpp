@@ -0,0 +1,212 @@
+#include "template.h"
+
+ChunkPager::ChunkPager()
+{
+	// chunk generation is cheap compared to rendering; two workers keep up with a flying camera
+	for (int i = 0; i < 2; i++) workers.push_back( thread( &ChunkPager::Worker, this ) );
+}
+
+ChunkPager::~ChunkPager()
+{
+	{
+		lock_guard<mutex> guard( lock );
+		quit = true;
+	}
+	wake.notify_all();
+	for (thread& worker : workers) worker.join();
+	for (Generated& chunk : done) FREE64( chunk.voxels );
+}
+
+static inline int3 BrickInChunk( const int i )
+{
+	// position of the i-th brick of a chunk, in bricks
+	const int N = CHUNKDIM / BRICKDIM;
+	return make_int3( i % N, (i / N) % N, i / (N * N) );
+}
+
+uint64_t ChunkPager::Key( const int3 chunk )
+{
+	// 21 bits per axis, biased to make them unsigned
+	const uint64_t x = (uint)(chunk.x + (1 << 20)) & 0x1fffff, y = (uint)(chunk.y + (1 << 20)) & 0x1fffff;
+	return x + (y << 21) + ((uint64_t)((uint)(chunk.z + (1 << 20)) & 0x1fffff) << 42);
+}
+
+void ChunkPager::Worker()
+{
+	while (1)
+	{
+		Generated chunk;
+		{
+			unique_lock<mutex> guard( lock );
+			wake.wait( guard, [this] { return quit || !queue.empty(); } );
+			if (quit) return;
+			chunk.pos = queue.back(), chunk.seed = seed;
+			queue.pop_back(), queued--;
+		}
+		// generate brick by brick, so that Update can add the bricks to the store as they are
+		chunk.voxels = (uint*)MALLOC64( CHUNKSIZE3 * sizeof( uint ) );
+		for (int i = 0; i < CHUNKBRICKS; i++)
+		{
+			const int3 brick = BrickInChunk( i );
+			Scene::GenerateBlock( chunk.voxels + i * BRICKSIZE, chunk.pos * CHUNKDIM + brick * BRICKDIM, BRICKDIM, BRICKDIM, BRICKDIM * BRICKDIM, chunk.seed );
+		}
+		lock_guard<mutex> guard( lock );
+		done.push_back( chunk );
+	}
+}
+
+bool ChunkPager::InWindow( const int3 chunk, const int margin ) const
+{
+	const int3 p = chunk - origin;
+	return p.x >= -margin && p.y >= -margin && p.z >= -margin &&
+		p.x < WINDOWDIM + margin && p.y < WINDOWDIM + margin && p.z < WINDOWDIM + margin;
+}
+
+void ChunkPager::CopyToGrid( Scene& scene, const int3 pos, const Chunk* chunk ) const
+{
+	// copy a chunk into the window, or clear its area if 'chunk' is null
+	const int3 p = (pos - origin) * CHUNKDIM;
+	for (int i = 0; i < CHUNKBRICKS; i++)
+	{
+		const int3 b = p + BrickInChunk( i ) * BRICKDIM;
+		const uint* voxels = store.Get( chunk ? chunk->brick[i] : 0 );
+		for (int z = 0; z < BRICKDIM; z++) for (int y = 0; y < BRICKDIM; y++)
+			memcpy( scene.grid + b.x + (b.y + y) * GRIDSIZE + (b.z + z) * GRIDSIZE2, voxels + y * BRICKDIM + z * BRICKDIM * BRICKDIM, BRICKDIM * sizeof( uint ) );
+		scene.MarkDirty( Scene::BrickIndex( b.x, b.y, b.z ) );
+	}
+}
+
+void ChunkPager::CopyFromGrid( const Scene& scene, Chunk& chunk )
+{
+	// bricks that were edited are replaced; the old brick may be shared with other chunks
+	const int3 p = (chunk.pos - origin) * CHUNKDIM;
+	ALIGN( 64 ) uint voxels[BRICKSIZE];
+	for (int i = 0; i < CHUNKBRICKS; i++)
+	{
+		const int3 b = p + BrickInChunk( i ) * BRICKDIM;
+		for (int z = 0; z < BRICKDIM; z++) for (int y = 0; y < BRICKDIM; y++)
+			memcpy( voxels + y * BRICKDIM + z * BRICKDIM * BRICKDIM, scene.grid + b.x + (b.y + y) * GRIDSIZE + (b.z + z) * GRIDSIZE2, BRICKDIM * sizeof( uint ) );
+		chunk.brick[i] = store.Replace( chunk.brick[i], voxels );
+	}
+}
+
+void ChunkPager::Release( Chunk& chunk )
+{
+	for (int i = 0; i < CHUNKBRICKS; i++) store.Release( chunk.brick[i] );
+}
+
+void ChunkPager::Refill( Scene& scene )
+{
+	// show the resident chunks of the window; the others are empty for now
+	for (int z = 0; z < WINDOWDIM; z++) for (int y = 0; y < WINDOWDIM; y++) for (int x = 0; x < WINDOWDIM; x++)
+	{
+		const int3 pos = origin + make_int3( x, y, z );
+		const auto it = chunks.find( Key( pos ) );
+		CopyToGrid( scene, pos, it == chunks.end() ? 0 : &it->second );
+	}
+}
+
+void ChunkPager::Reset( Scene& scene, const uint worldSeed )
+{
+	// start paging a world with the given seed; this discards all chunks
+	{
+		lock_guard<mutex> guard( lock );
+		for (const int3& chunk : queue) requested.erase( Key( chunk ) );
+		queue.clear(), queued = 0;
+		seed = worldSeed;
+	}
+	for (auto& chunk : chunks) Release( chunk.second );
+	chunks.clear(), lru.clear();
+	origin = make_int3( 0 );
+	Refill( scene );
+}
+
+int3 ChunkPager::Update( Scene& scene, Camera& camera )
+{
+	// move the window when the camera leaves its central chunks
+	const float3 P = camera.camPos * (float)WINDOWDIM;
+	const int3 c = make_int3( (int)floorf( P.x ), (int)floorf( P.y ), (int)floorf( P.z ) );
+	const int3 delta = c - clamp( c, WINDOWDIM / 2 - 1, WINDOWDIM / 2 );
+	if (delta.x || delta.y || delta.z)
+	{
+		for (int z = 0; z < WINDOWDIM; z++) for (int y = 0; y < WINDOWDIM; y++) for (int x = 0; x < WINDOWDIM; x++)
+		{
+			// keep edits made in the grid
+			const auto it = chunks.find( Key( origin + make_int3( x, y, z ) ) );
+			if (it != chunks.end()) CopyFromGrid( scene, it->second );
+		}
+		origin = origin + delta;
+		const float3 shift = make_float3( delta ) * ((float)CHUNKDIM / GRIDSIZE);
+		camera.Translate( -shift );
+		for (Instance& instance : scene.instances.instances)
+		{
+			instance.position -= shift, instance.bmin -= shift, instance.bmax -= shift;
+			// a transformed instance takes rays to model space with its inverse
+			if (instance.transformed) instance.inverse = instance.inverse * mat4::Translate( shift );
+		}
+		scene.instances.dirty = true;
+		Refill( scene );
+	}
+	// take in generated chunks; chunks generated with an old seed are dropped
+	vector<Generated> generated;
+	{
+		lock_guard<mutex> guard( lock );
+		generated.swap( done );
+		for (const Generated& chunk : generated) requested.erase( Key( chunk.pos ) );
+	}
+	for (Generated& g : generated)
+	{
+		if (g.seed == seed)
+		{
+			const uint64_t key = Key( g.pos );
+			Chunk& chunk = chunks[key];
+			chunk.pos = g.pos;
+			for (int i = 0; i < CHUNKBRICKS; i++) chunk.brick[i] = store.Add( g.voxels + i * BRICKSIZE );
+			lru.push_front( key ), chunk.lru = lru.begin();
+			if (InWindow( chunk.pos, 0 )) CopyToGrid( scene, chunk.pos, &chunk );
+		}
+		FREE64( g.voxels );
+	}
+	// queue the missing chunks of the window and a margin around it, nearest
+	// to the camera last, so that workers take those first
+	vector<int3> missing;
+	for (int z = -1; z <= WINDOWDIM; z++) for (int y = -1; y <= WINDOWDIM; y++) for (int x = -1; x <= WINDOWDIM; x++)
+	{
+		const int3 chunk = origin + make_int3( x, y, z );
+		const uint64_t key = Key( chunk );
+		const auto it = chunks.find( key );
+		if (it == chunks.end()) { missing.push_back( chunk ); continue; }
+		// chunks in view are used; move them to the front of the LRU list
+		lru.splice( lru.begin(), lru, it->second.lru );
+	}
+	const int3 camChunk = origin + c - delta;
+	sort( missing.begin(), missing.end(), [camChunk]( const int3& a, const int3& b ) {
+		const int3 da = a - camChunk, db = b - camChunk;
+		return da.x * da.x + da.y * da.y + da.z * da.z > db.x * db.x + db.y * db.y + db.z * db.z;
+	} );
+	{
+		lock_guard<mutex> guard( lock );
+		for (const int3& chunk : queue) requested.erase( Key( chunk ) );
+		queue.clear();
+		for (const int3& chunk : missing) if (requested.insert( Key( chunk ) ).second) queue.push_back( chunk );
+		queued = (int)queue.size();
+	}
+	wake.notify_all();
+	Evict();
+	return delta;
+}
+
+void ChunkPager::Evict()
+{
+	// drop least recently used chunks until the budget is met; chunks in and
+	// around the window are never evicted
+	auto it = lru.end();
+	while (MemoryUsed() > budget && it != lru.begin())
+	{
+		const auto chunk = chunks.find( *--it );
+		if (InWindow( chunk->second.pos, 1 )) continue;
+		Release( chunk->second );
+		chunks.erase( chunk );
+		it = lru.erase( it );
+	}
+}
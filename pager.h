@@ -0,0 +1,74 @@
+#pragma once
+
+#define CHUNKDIM	32			// voxels per chunk along each axis; a multiple of BRICKDIM
+#define CHUNKSIZE3	(CHUNKDIM*CHUNKDIM*CHUNKDIM)
+#define CHUNKBRICKS	((CHUNKDIM/BRICKDIM)*(CHUNKDIM/BRICKDIM)*(CHUNKDIM/BRICKDIM))
+#define WINDOWDIM	(GRIDSIZE/CHUNKDIM)	// chunks in the scene grid along each axis
+
+namespace Tmpl8 {
+
+// ChunkPager: an unbounded procedural world, of which the scene grid shows a
+// window around the camera. The world is divided in chunks of CHUNKDIM^3
+// voxels, which are generated on worker threads, nearest to the camera first.
+// Resident chunks are lists of bricks in a BrickStore, so identical bricks,
+// such as empty or fully solid ones, are stored once. They stay resident until
+// the memory budget is exceeded; then the least recently used chunks outside
+// the window are evicted, and will be generated again when the camera returns.
+// When the camera leaves the central chunks of the window, the window moves
+// by whole chunks: edits in the grid are written back to their chunks, the
+// grid is refilled from the resident chunks, and the camera and instances are
+// translated by the opposite amount, so that the world stays in the unit
+// cube. Chunks that are not resident yet are empty in the grid until their
+// worker finishes.
+class ChunkPager
+{
+public:
+	ChunkPager();
+	~ChunkPager();
+	void Reset( Scene& scene, const uint seed );
+	int3 Update( Scene& scene, Camera& camera );	// returns the window shift, in chunks
+	// status, for display
+	int Resident() const { return (int)chunks.size(); }
+	int Queued() const { return queued; }
+	size_t MemoryUsed() const { return store.MemoryUsed() + chunks.size() * sizeof( Chunk ); }
+	size_t DenseSize() const { return chunks.size() * CHUNKSIZE3 * sizeof( uint ); }
+	const BrickStore& Store() const { return store; }
+	// data members
+	int3 origin = make_int3( 0 );	// world chunk coordinates of the window's first chunk
+	size_t budget = 256 << 20;		// bytes of chunk data to keep resident, after deduplication
+private:
+	struct Chunk
+	{
+		int3 pos;					// world chunk coordinates
+		uint brick[CHUNKBRICKS];	// BrickStore ids, x fastest
+		list<uint64_t>::iterator lru;
+	};
+	struct Generated
+	{
+		int3 pos;
+		uint seed;					// seed it was generated with
+		uint* voxels;				// CHUNKBRICKS bricks of BRICKSIZE voxels
+	};
+	static uint64_t Key( const int3 chunk );
+	void Worker();
+	bool InWindow( const int3 chunk, const int margin ) const;
+	void CopyToGrid( Scene& scene, const int3 pos, const Chunk* chunk ) const;
+	void CopyFromGrid( const Scene& scene, Chunk& chunk );
+	void Release( Chunk& chunk );
+	void Refill( Scene& scene );
+	void Evict();
+	BrickStore store;
+	unordered_map<uint64_t, Chunk> chunks;	// resident chunks
+	list<uint64_t> lru;				// resident chunks, most recently used first
+	vector<thread> workers;
+	mutex lock;						// guards queue, requested, done and seed
+	condition_variable wake;
+	vector<int3> queue;				// chunks to generate, nearest to the camera last
+	unordered_set<uint64_t> requested;	// queued or in progress
+	vector<Generated> done;			// generated, not yet resident
+	uint seed = 1;
+	bool quit = false;
+	atomic<int> queued = 0;			// size of the queue
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,163 @@
+#include "template.h"
+
+Physics::Physics()
+{
+	const size_t bytes = (size_t)GRIDSIZE2 * ROWWORDS * sizeof( uint64_t );
+	occupancy = (uint64_t*)MALLOC64( bytes );
+	memset( occupancy, 0, bytes );
+}
+
+Physics::~Physics()
+{
+	FREE64( occupancy );
+}
+
+void Physics::Update( const Scene& target )
+{
+	scene = &target;
+	if (!target.edited) return;
+	// a brick row of 8 voxels is one byte of the bitmask (x86 is little endian),
+	// so bricks can be updated in parallel without touching each other's bytes
+	const vector<uint>& bricks = target.dirtyBricks;
+	uchar* rows = (uchar*)occupancy;
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)bricks.size(); i++)
+	{
+		const int bx = bricks[i] % GRIDBRICKS, by = (bricks[i] / GRIDBRICKS) % GRIDBRICKS, bz = bricks[i] / GRIDBRICKS2;
+		for (int z = bz * BRICKDIM; z < (bz + 1) * BRICKDIM; z++) for (int y = by * BRICKDIM; y < (by + 1) * BRICKDIM; y++)
+		{
+			const uint* v = target.grid + bx * BRICKDIM + y * GRIDSIZE + z * GRIDSIZE2;
+			uchar bits = 0;
+			for (int x = 0; x < BRICKDIM; x++) bits |= (v[x] != 0) << x;
+			rows[(y + z * GRIDSIZE) * ROWWORDS * 8 + bx] = bits;
+		}
+	}
+}
+
+static inline uint64_t RowMask( const int word, const int x0, const int x1 )
+{
+	// bits of 'word' that cover voxels [x0, x1) of a row
+	const int a = max( x0 - word * 64, 0 ), b = min( x1 - word * 64, 64 );
+	if (a >= b) return 0;
+	return (b == 64 ? ~0ull : (1ull << b) - 1) & ~((1ull << a) - 1);
+}
+
+static inline bool Interval( const float b0, const float b1, const float d, const int v, float& enter, float& exit )
+{
+	// times at which the box span [b0, b1] moving by d overlaps voxel span [v, v + 1]
+	if (d == 0)
+	{
+		if (b1 <= v || b0 >= v + 1) return false;
+		enter = -1e30f, exit = 1e30f;
+		return true;
+	}
+	const float t1 = (v - b1) / d, t2 = (v + 1 - b0) / d;
+	enter = min( t1, t2 ), exit = max( t1, t2 );
+	return true;
+}
+
+void Physics::Raycast( const RayQuery* queries, RayHit* hits, const int count ) const
+{
+	shared_lock<shared_mutex> guard;
+	if (lock) guard = shared_lock<shared_mutex>( *lock );
+	// queries are small: hand them to the threads in groups
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < count; i++)
+	{
+		const RayQuery& q = queries[i];
+		Ray ray( q.O, q.D, q.length );
+		scene->FindNearest( ray );
+		// distances are measured from the origin before FindNearest nudged it
+		if (ray.inside) hits[i] = { 0, ray.voxel, -q.D };
+		else if (ray.voxel && ray.t + EPSILON < q.length) hits[i] = { ray.t + EPSILON, ray.voxel, ray.GetNormal() };
+		else hits[i] = { q.length, 0, float3( 0 ) };
+	}
+}
+
+void Physics::Occluded( const RayQuery* queries, uchar* occluded, const int count ) const
+{
+	shared_lock<shared_mutex> guard;
+	if (lock) guard = shared_lock<shared_mutex>( *lock );
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < count; i++)
+	{
+		Ray ray( queries[i].O, queries[i].D, queries[i].length );
+		occluded[i] = scene->IsOccluded( ray ) ? 1 : 0;
+	}
+}
+
+void Physics::Sweep( const SweepQuery* queries, SweepHit* hits, const int count ) const
+{
+	shared_lock<shared_mutex> guard;
+	if (lock) guard = shared_lock<shared_mutex>( *lock );
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < count; i++) hits[i] = Sweep( queries[i] );
+}
+
+void Physics::Overlap( const BoxQuery* queries, uint* counts, const int count ) const
+{
+	shared_lock<shared_mutex> guard;
+	if (lock) guard = shared_lock<shared_mutex>( *lock );
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < count; i++) counts[i] = Overlap( queries[i] );
+}
+
+Physics::SweepHit Physics::Sweep( const SweepQuery& query ) const
+{
+	// in voxel units: test the box against each solid voxel in the region it sweeps
+	const float3 b0 = query.bmin * GRIDSIZE, b1 = query.bmax * GRIDSIZE, d = query.delta * GRIDSIZE;
+	const float3 smin = fminf( b0, b0 + d ), smax = fmaxf( b1, b1 + d );
+	const int3 lo = max( make_int3( (int)floorf( smin.x ), (int)floorf( smin.y ), (int)floorf( smin.z ) ), make_int3( 0 ) );
+	const int3 hi = min( make_int3( (int)ceilf( smax.x ), (int)ceilf( smax.y ), (int)ceilf( smax.z ) ), make_int3( GRIDSIZE ) );
+	SweepHit hit = { 1, 0, float3( 0 ) };
+	int axis = 0;
+	for (int z = lo.z; z < hi.z; z++)
+	{
+		float zEnter, zExit;
+		if (!Interval( b0.z, b1.z, d.z, z, zEnter, zExit ) || zExit <= 0 || zEnter >= hit.t) continue;
+		for (int y = lo.y; y < hi.y; y++)
+		{
+			// skip rows that the box does not reach in time
+			float yEnter, yExit;
+			if (!Interval( b0.y, b1.y, d.y, y, yEnter, yExit )) continue;
+			const float rowEnter = max( yEnter, zEnter ), rowExit = min( yExit, zExit );
+			if (rowEnter >= rowExit || rowExit <= 0 || rowEnter >= hit.t) continue;
+			const uint64_t* row = occupancy + (y + z * GRIDSIZE) * ROWWORDS;
+			for (int w = lo.x >> 6; w <= (hi.x - 1) >> 6; w++)
+			{
+				uint64_t bits = row[w] & RowMask( w, lo.x, hi.x );
+				while (bits)
+				{
+					// index of the lowest set bit
+					const int x = w * 64 + (int)_mm_popcnt_u64( (bits & (0 - bits)) - 1 );
+					bits &= bits - 1;
+					float xEnter, xExit;
+					if (!Interval( b0.x, b1.x, d.x, x, xEnter, xExit )) continue;
+					const float enter = max( xEnter, rowEnter ), exit = min( xExit, rowExit );
+					// voxels overlapped at the start have enter < 0 and are ignored
+					if (enter >= exit || enter < 0 || enter >= hit.t) continue;
+					hit.t = enter, hit.voxel = scene->grid[x + y * GRIDSIZE + z * GRIDSIZE2];
+					axis = enter == xEnter ? 0 : enter == yEnter ? 1 : 2;
+				}
+			}
+		}
+	}
+	if (hit.voxel) hit.N.cell[axis] = d.cell[axis] > 0 ? -1.0f : 1.0f;
+	return hit;
+}
+
+uint Physics::Overlap( const BoxQuery& query ) const
+{
+	// voxels that overlap the box with a nonzero volume, counted 64 at a time
+	const float3 b0 = query.bmin * GRIDSIZE, b1 = query.bmax * GRIDSIZE;
+	const int3 lo = max( make_int3( (int)floorf( b0.x ), (int)floorf( b0.y ), (int)floorf( b0.z ) ), make_int3( 0 ) );
+	const int3 hi = min( make_int3( (int)ceilf( b1.x ), (int)ceilf( b1.y ), (int)ceilf( b1.z ) ), make_int3( GRIDSIZE ) );
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return 0;
+	uint solid = 0;
+	for (int z = lo.z; z < hi.z; z++) for (int y = lo.y; y < hi.y; y++)
+	{
+		const uint64_t* row = occupancy + (y + z * GRIDSIZE) * ROWWORDS;
+		for (int w = lo.x >> 6; w <= (hi.x - 1) >> 6; w++) solid += (uint)_mm_popcnt_u64( row[w] & RowMask( w, lo.x, hi.x ) );
+	}
+	return solid;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// occupancy bitmask: one bit per voxel, rows of GRIDSIZE bits along x
+#define ROWWORDS	((GRIDSIZE + 63) / 64)
+
+namespace Tmpl8 {
+
+// Physics: batched collision queries for gameplay code.
+// Queries are const and never modify the scene or the caller's data other than
+// the result arrays, so any number of threads may query at once. They must
+// not overlap the writes between frames: the grid, the instance BVH and the
+// occupancy mask. If 'lock' is set, each batch holds it shared, so batches of
+// different threads still run at once; the renderer points it at
+// EditQueue::frameLock, which it holds exclusively while it updates all three
+// (see Renderer::Tick). A batch must then not be issued by the thread that
+// holds it. Each batch is spread over the worker threads. Positions and distances
+// are in world units, like those of Ray.
+// - Raycast: nearest hit, using the DDA of Scene::FindNearest, including the
+//   instances. A ray that starts in a solid voxel hits it at distance 0.
+// - Occluded: line of sight; 1 if anything solid lies within 'length'.
+// - Sweep: an axis-aligned box moved by 'delta', against the solid voxels of
+//   the grid: the fraction of delta it can travel before it touches a voxel,
+//   and the normal of the face it touches. Voxels the box already overlaps are
+//   ignored, so that a box that got stuck can move out.
+// - Overlap: the number of solid voxels a box overlaps.
+// Sweep and Overlap read an occupancy bitmask that Update keeps in sync with
+// the dirty bricks of the scene; a 64-bit word covers 64 voxels of a row.
+class Physics
+{
+public:
+	struct RayQuery { float3 O, D; float length; };			// D is normalized
+	struct RayHit { float t; uint voxel; float3 N; };		// voxel 0: no hit within length
+	struct SweepQuery { float3 bmin, bmax, delta; };
+	struct SweepHit { float t; uint voxel; float3 N; };	// t = 1, voxel 0: no contact
+	struct BoxQuery { float3 bmin, bmax; };
+	Physics();
+	~Physics();
+	void Update( const Scene& scene );
+	void Raycast( const RayQuery* queries, RayHit* hits, const int count ) const;
+	void Occluded( const RayQuery* queries, uchar* occluded, const int count ) const;
+	void Sweep( const SweepQuery* queries, SweepHit* hits, const int count ) const;
+	void Overlap( const BoxQuery* queries, uint* counts, const int count ) const;
+	bool Solid( const int x, const int y, const int z ) const
+	{
+		return (occupancy[(y + z * GRIDSIZE) * ROWWORDS + (x >> 6)] >> (x & 63)) & 1;
+	}
+	// data members
+	uint64_t* occupancy;		// (y + z * GRIDSIZE) * ROWWORDS + x / 64
+	const Scene* scene = 0;
+	shared_mutex* lock = 0;		// held shared by each batch, if set
+private:
+	SweepHit Sweep( const SweepQuery& query ) const;
+	uint Overlap( const BoxQuery& query ) const;
+};
+
+} // namespace Tmpl8
@@ -1,8 +1,16 @@
 #include "template.h"
 
 Ray::Ray( const float3 origin, const float3 direction, const float rayLength, const uint rgb )
-	: O( origin ), D( normalize( direction ) ), t( rayLength ), voxel( rgb )
 {
+	Reset( origin, normalize( direction ), rayLength );
+	voxel = rgb;
+}
+
+void Ray::Reset( const float3& origin, const float3& unitDirection, const float rayLength )
+{
+	// reinitialize an existing ray; used by the path tracer to avoid constructing
+	// a new ray per bounce. The direction must be normalized.
+	O = origin, D = unitDirection, t = rayLength, voxel = 0, axis = 0, inside = false;
 	// calculate reciprocal ray direction for triangles and AABBs
 	// TODO: prevent NaNs - or don't
 	rD = float3( 1 / D.x, 1 / D.y, 1 / D.z );
@@ -20,6 +28,7 @@ Ray::Ray( const float3 origin, const float3 direction, const float rayLength, co
 float3 Ray::GetNormal() const
 {
 	// return the voxel normal at the nearest intersection
+	if (axis == 3) return N;
 	const float3 sign = Dsign * 2 - 1;
 	return float3( axis == 0 ? sign.x : 0, axis == 1 ? sign.y : 0, axis == 2 ? sign.z : 0 );
 }
@@ -28,4 +37,40 @@ float3 Ray::GetAlbedo() const
 {
 	// return the (floating point) albedo at the nearest intersection
 	return RGB8_to_RGBF32( voxel );
-}
\ No newline at end of file
+}
+
+float3 Ray::GetEmission() const
+{
+	// radiance emitted by the voxel at the nearest intersection
+	return voxel & EMISSIVE ? GetAlbedo() * EMISSION_SCALE : float3( 0 );
+}
+
+float Ray::GetReflectivity( const float3& ) const
+{
+	// fraction of light that is reflected specularly at the nearest intersection
+	const uint material = GetMaterial();
+	if (material == MATERIAL_MIRROR || material == MATERIAL_GLOSSY) return 1;
+	if (material != MATERIAL_GLASS) return 0;
+	// Fresnel, Schlick's approximation; total internal reflection when leaving glass
+	const float cosi = -dot( GetNormal(), D ), eta = inside ? 1.5f : 1 / 1.5f;
+	const float k = 1 - eta * eta * (1 - cosi * cosi);
+	if (k < 0) return 1;
+	const float cosAir = inside ? sqrtf( k ) : cosi;
+	return 0.04f + 0.96f * pow5f( 1 - cosAir );
+}
+
+float Ray::GetRefractivity( const float3& I ) const
+{
+	// fraction of light that is transmitted at the nearest intersection
+	return GetMaterial() == MATERIAL_GLASS ? 1 - GetReflectivity( I ) : 0;
+}
+
+float3 Ray::GetAbsorption( const float3& ) const
+{
+	// absorption coefficient per unit distance for glass: albedo is the fraction
+	// of light that survives a path of 8 voxels through the material
+	if (GetMaterial() != MATERIAL_GLASS) return float3( 0 );
+	const float3 albedo = GetAlbedo();
+	const float3 density = float3( -logf( max( albedo.x, 0.001f ) ), -logf( max( albedo.y, 0.001f ) ), -logf( max( albedo.z, 0.001f ) ) );
+	return density * (GRIDSIZE / 8.0f);
+}
@@ -1,17 +1,36 @@
 #pragma once
 
+// voxel payload layout: 24-bit rgb albedo in the lower bits, material in the upper bits
+#define MATERIAL_MASK	(3 << 24)
+#define MATERIAL_DIFFUSE	(0 << 24)
+#define MATERIAL_MIRROR	(1 << 24)	// perfect specular reflection, tinted by albedo
+#define MATERIAL_GLASS	(2 << 24)	// dielectric; albedo sets absorption
+#define MATERIAL_GLOSSY	(3 << 24)	// rough reflection, approximated with a cone trace
+#define EMISSIVE		(1 << 26)	// flag: the voxel emits its albedo, scaled by EMISSION_SCALE
+#define EMISSION_SCALE	8.0f
+#define SIM_SAND		(1 << 27)	// flag: falls and slides off slopes, see Automaton
+#define SIM_FLUID		(1 << 28)	// flag: falls and spreads sideways
+#define SIM_MOVED		(1 << 29)	// used within Automaton::Step only
+// model files (.bin, .vxb) only hold albedo; the upper bits are cleared when
+// they are read, since some assets, such as viking.bin, store other data there
+#define MODEL_ALBEDO	0x00ffffff
+
 namespace Tmpl8 {
 
 class Ray
 {
 public:
+	Ray() = default;
 	Ray( const float3 origin, const float3 direction, const float rayLength = 1e34f, const uint rgb = 0 );
+	void Reset( const float3& origin, const float3& unitDirection, const float rayLength = 1e34f );
 	float3 IntersectionPoint() const { return O + t * D; }
 	float3 GetNormal() const;
 	float3 GetAlbedo() const;
-	float GetReflectivity( const float3& I ) const; // TODO: implement
-	float GetRefractivity( const float3& I ) const; // TODO: implement
-	float3 GetAbsorption( const float3& I ) const; // TODO: implement
+	uint GetMaterial() const { return voxel & MATERIAL_MASK; }
+	float3 GetEmission() const;
+	float GetReflectivity( const float3& I ) const;
+	float GetRefractivity( const float3& I ) const;
+	float3 GetAbsorption( const float3& I ) const;
 	// ray data
 	float3 O;					// ray origin
 	float3 rD;					// reciprocal ray direction
@@ -19,7 +38,8 @@ public:
 	float t;					// ray length
 	float3 Dsign;				// inverted ray direction signs, -1 or 1
 	uint voxel;					// payload of the intersected voxel
-	uint axis = 0;				// axis of last plane passed by the ray
+	uint axis = 0;				// axis of last plane passed by the ray; 3: the hit normal is N
+	float3 N;					// normal of a hit in a transformed instance, when axis is 3
 	bool inside = false;		// if true, ray started in voxel and t is at exit point
 private:
 	// min3 is used in normal reconstruction.
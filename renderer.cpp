@@ -3,14 +3,145 @@
 // -----------------------------------------------------------
 // Calculate light transport via a ray
 // -----------------------------------------------------------
-float3 Renderer::Trace( Ray& ray, int, int, int /* we'll use these later */ )
+float3 Renderer::Trace( Ray& ray )
 {
 	scene.FindNearest( ray );
-	if (ray.voxel == 0) return float3( 0 ); // or a fancy sky color
-	float3 N = ray.GetNormal();
-	float3 I = ray.IntersectionPoint();
-	float3 albedo = ray.GetAlbedo();
-	return (N + 1) * 0.5f;
+	if (ray.voxel == 0) return sky.Lookup( ray.D );
+	PathState path;
+	const float3 radiance = Shade( ray, path );
+	rayPool += path.reserve;
+	return radiance;
+}
+
+// -----------------------------------------------------------
+// Take a ray from the frame budget. Rays are reserved in chunks
+// so that threads rarely touch the shared counter.
+// -----------------------------------------------------------
+bool Renderer::SpendRay( PathState& path )
+{
+	if (path.reserve == 0)
+	{
+		const int available = rayPool.fetch_sub( 256 );
+		if (available <= 0) return false;
+		path.reserve = min( 256, available );
+	}
+	path.reserve--, path.rays++;
+	return true;
+}
+
+// -----------------------------------------------------------
+// Path tracing for a ray for which the nearest intersection is
+// known. The ray is reused for every bounce; the path ends on a
+// miss, by russian roulette, when its throughput becomes
+// negligible, or when the frame's ray budget is exhausted.
+// -----------------------------------------------------------
+float3 Renderer::Shade( Ray& ray, PathState& path )
+{
+	float3 radiance( 0 ), throughput( 1 );
+	float bsdfPdf = 0; // pdf of the last bounce; 0 for specular bounces
+	Ray shadow;
+	path.paths++;
+	for (int bounce = 0;; bounce++)
+	{
+		path.segments++;
+		const float3 I = ray.IntersectionPoint(), N = ray.GetNormal();
+		// emission is counted on camera rays and after specular bounces; after a
+		// diffuse bounce, emitters were already sampled by next event estimation
+		if (!ray.inside && bsdfPdf == 0) radiance += throughput * ray.GetEmission();
+		// glass absorbs light along the segment that was travelled inside it
+		if (ray.inside) throughput *= expf( -ray.GetAbsorption( I ) * ray.t );
+		if (bounce == maxBounces) break;
+		const uint material = ray.GetMaterial();
+		const float3 albedo = ray.GetAlbedo();
+		float3 R;
+		if (material == MATERIAL_DIFFUSE)
+		{
+			// next event estimation: importance sampled sky, MIS with the bsdf
+			if (SpendRay( path ))
+			{
+				float3 L;
+				float lightPdf;
+				const float3 Lsky = sky.Sample( RandomFloat(), RandomFloat(), L, lightPdf );
+				const float cosTheta = dot( N, L );
+				if (lightPdf > 0 && cosTheta > 0)
+				{
+					shadow.Reset( I, L );
+					if (!scene.IsOccluded( shadow ))
+					{
+						const float pdf = cosTheta * INVPI, w = sqrf( lightPdf ) / (sqrf( lightPdf ) + sqrf( pdf ));
+						radiance += throughput * albedo * Lsky * (INVPI * cosTheta * w / lightPdf);
+					}
+				}
+			}
+			// next event estimation: one emissive voxel, picked with the light tree
+			if (lights.Count() && SpendRay( path ))
+			{
+				float3 L;
+				float dist, lightPdf;
+				const float3 Le = lights.Sample( I, L, dist, lightPdf );
+				const float cosTheta = dot( N, L );
+				if (lightPdf > 0 && cosTheta > 0)
+				{
+					// stop just short of the emitter so that it does not occlude itself
+					shadow.Reset( I, L, dist - 0.1f / GRIDSIZE );
+					if (!scene.IsOccluded( shadow )) radiance += throughput * albedo * Le * (INVPI * cosTheta / lightPdf);
+				}
+			}
+			// continue with a cosine-weighted bounce; cos / pdf cancels
+			R = cosineweighteddiffusereflection( N, RandomFloat(), RandomFloat() );
+			bsdfPdf = dot( N, R ) * INVPI;
+			throughput *= albedo;
+		}
+		else if (material == MATERIAL_GLOSSY)
+		{
+			// rough reflection: one cone through the mip volume replaces the rest
+			// of the path. Occluders reflect ambient sky light; the unoccluded
+			// part of the cone sees the sky itself.
+			const float3 G = reflect( ray.D, N );
+			float3 occluders;
+			const float visibility = mips.ConeTrace( I + N * (1.0f / GRIDSIZE), G, glossiness, 2.0f, occluders );
+			radiance += throughput * albedo * (occluders * sky.average + visibility * sky.Lookup( G ));
+			break;
+		}
+		else
+		{
+			// mirror or glass: reflect or refract, chosen by the fresnel term
+			if (RandomFloat() < ray.GetReflectivity( I ))
+			{
+				R = reflect( ray.D, N );
+				if (material == MATERIAL_MIRROR) throughput *= albedo;
+			}
+			else
+			{
+				const float eta = ray.inside ? 1.5f : 1 / 1.5f, cosi = -dot( N, ray.D );
+				const float k = 1 - eta * eta * (1 - cosi * cosi);
+				R = normalize( eta * ray.D + (eta * cosi - sqrtf( k )) * N );
+			}
+			bsdfPdf = 0;
+		}
+		// terminate paths that no longer contribute meaningfully
+		float p = max( throughput.x, max( throughput.y, throughput.z ) );
+		if (p < cullThreshold) break;
+		if (bounce > 1)
+		{
+			p = min( p, 0.95f );
+			if (RandomFloat() > p) break;
+			throughput *= 1 / p;
+		}
+		// extend the path
+		if (!SpendRay( path )) break;
+		ray.Reset( I, R );
+		scene.FindNearest( ray );
+		if (ray.voxel == 0)
+		{
+			// the path escaped; after a diffuse bounce the sky was also sampled directly
+			float w = 1;
+			if (bsdfPdf > 0) w = sqrf( bsdfPdf ) / (sqrf( bsdfPdf ) + sqrf( sky.Pdf( R ) ));
+			radiance += throughput * sky.Lookup( R ) * w;
+			break;
+		}
+	}
+	return radiance;
 }
 
 // -----------------------------------------------------------
@@ -18,6 +149,14 @@ float3 Renderer::Trace( Ray& ray, int, int, int /* we'll use these later */ )
 // -----------------------------------------------------------
 void Renderer::Init()
 {
+	// load the sky; rays that miss the voxel world sample this
+	sky.Load( "assets/LDR_RG01_0.png" );
+	// allocate the accumulator; the denoiser filters it before display
+	accumulator = (float3*)MALLOC64( SCRWIDTH * SCRHEIGHT * sizeof( float3 ) );
+	// physics queries from other threads wait while Tick updates the world
+	physics.lock = &edits.frameLock;
+	// replay the edits made after the snapshot the world was restored from
+	journal.Open( (stateFile + ".journal").c_str(), scene );
 }
 
 // -----------------------------------------------------------
@@ -27,28 +166,223 @@ void Renderer::Tick( float deltaTime )
 {
 	// high-resolution timer, see template.h
 	Timer t;
+	// publish edits committed by other threads, bricks prepared by the asset
+	// streamer and changes replicated from a server, then bring derived data
+	// up to date; no rays are traced meanwhile, and physics queries from other
+	// threads wait
+	{
+		lock_guard<shared_mutex> frame( edits.frameLock );
+		edits.Apply( scene );
+		if (client.Connected()) client.Update( scene );
+		streamer.Publish( scene );
+		if (paging) edits.Shift( pager.Update( scene, camera ) * (CHUNKDIM / BRICKDIM) );
+		// the automaton steps at SIMRATE Hz, independent of the frame rate
+		if (simulate)
+		{
+			Timer simTimer;
+			int steps = 0;
+			for (simTime = min( simTime + deltaTime, 1000.0f * SIMSTEPS / SIMRATE ); simTime >= 1000.0f / SIMRATE; simTime -= 1000.0f / SIMRATE, steps++) automaton.Step( scene );
+			if (steps) stepTime = simTimer.elapsed() * 1000 / steps;
+		}
+		// moving sprites only need a refit of the instance BVH
+		Timer swarmTimer;
+		if (swarm) MoveSwarm( deltaTime );
+		if (vehicles) MoveVehicles( deltaTime );
+		if (scene.instances.dirty) scene.instances.Build(); else if (scene.instances.moved) scene.instances.Refit();
+		if (swarm) swarmUpdate = swarmTimer.elapsed() * 1000;
+		// the journal records the edits of each frame. Window shifts of the pager
+		// rewrite the grid, so it pauses while paging, and starts over from a new
+		// snapshot after that. A full journal is compacted into a new snapshot.
+		if (paging) journalPaused = true;
+		else if (journalPaused) journal.Restart( scene ), journalPaused = false, SaveState( stateFile.c_str() );
+		else journal.Record( scene );
+		if (journal.Full()) SaveState( stateFile.c_str() );
+		server.Update( scene, journal );
+		if (scene.edited) automaton.Wake( scene ), mips.Update( scene ), lights.Update( scene ), physics.Update( scene ), scene.ClearDirty();
+	}
+	// level of detail for instances: the angle of a pixel, scaled by the bias
+	const float3 screenCenter = (camera.topRight + camera.bottomLeft) * 0.5f;
+	const float pixelAngle = length( camera.topRight - camera.topLeft ) / (SCRWIDTH * length( screenCenter - camera.camPos ));
+	scene.instances.lodScale = pixelAngle * lodBias;
+	// primary rays are always traced; the remaining budget is for the path tracer
+	rayPool = rayBudget - SCRWIDTH * SCRHEIGHT;
+	uint rays = 0, segments = 0, paths = 0;
 	// pixel loop: lines are executed as OpenMP parallel tasks (disabled in DEBUG)
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(dynamic) reduction(+:rays,segments,paths)
 	for (int y = 0; y < SCRHEIGHT; y++)
 	{
+		PathState path;
+		// rays that leave the world are collected, and shaded 8 at a time
+		ALIGN( 32 ) float Dx[SCRWIDTH + 8], Dy[SCRWIDTH + 8], Dz[SCRWIDTH + 8];
+		int missed[SCRWIDTH], misses = 0;
 		// trace a primary ray for each pixel on the line
 		for (int x = 0; x < SCRWIDTH; x++)
 		{
 			Ray r = camera.GetPrimaryRay( (float)x, (float)y );
-			float3 pixel = Trace( r );
-			screen->pixels[x + y * SCRWIDTH] = RGBF32_to_RGB8( pixel );
+			scene.FindNearest( r );
+			// store denoiser guides
+			const int pixelIdx = x + y * SCRWIDTH;
+			denoiser.depth[pixelIdx] = r.voxel ? r.t : 1e34f;
+			if (r.axis == 3)
+			{
+				// faces of transformed instances are binned by their dominant axis
+				const float3 A = fabs( r.N );
+				const int a = A.x > A.y ? (A.x > A.z ? 0 : 2) : (A.y > A.z ? 1 : 2);
+				denoiser.normal[pixelIdx] = a * 2 + (r.N[a] > 0);
+			}
+			else denoiser.normal[pixelIdx] = r.voxel ? r.axis * 2 + (r.Dsign[r.axis] > 0.5f) : 6;
+			denoiser.voxel[pixelIdx] = r.voxel;
+			if (r.voxel == 0)
+			{
+				Dx[misses] = r.D.x, Dy[misses] = r.D.y, Dz[misses] = r.D.z;
+				missed[misses++] = x;
+				continue;
+			}
+			accumulator[pixelIdx] = Shade( r, path );
+		}
+		rayPool += path.reserve;
+		rays += path.rays, segments += path.segments, paths += path.paths;
+		// sky lookups for the missed rays; pad the last packet with a valid direction
+		for (int i = misses; i < ((misses + 7) & ~7); i++) Dx[i] = Dz[i] = 0, Dy[i] = 1;
+		for (int i = 0; i < misses; i += 8)
+		{
+			ALIGN( 32 ) float r[8], g[8], b[8];
+			__m256 r8, g8, b8;
+			sky.Lookup8( _mm256_load_ps( Dx + i ), _mm256_load_ps( Dy + i ), _mm256_load_ps( Dz + i ), r8, g8, b8 );
+			_mm256_store_ps( r, r8 ), _mm256_store_ps( g, g8 ), _mm256_store_ps( b, b8 );
+			for (int j = 0; j < min( 8, misses - i ); j++)
+				accumulator[missed[i + j] + y * SCRWIDTH] = float3( r[j], g[j], b[j] );
 		}
 	}
+	// filter and display
+	if (denoiser.enabled) denoiser.Apply( accumulator );
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < SCRWIDTH * SCRHEIGHT; i++) screen->pixels[i] = RGBF32_to_RGB8( accumulator[i] );
+	// path statistics
+	raysTraced = SCRWIDTH * SCRHEIGHT + rays;
+	avgPathLength = paths ? (float)segments / paths : 0;
 	// performance report - running average - ms, MRays/s
 	static float avg = 10, alpha = 1;
 	avg = (1 - alpha) * avg + alpha * t.elapsed() * 1000;
 	if (alpha > 0.05f) alpha *= 0.5f;
-	float fps = 1000.0f / avg, rps = (SCRWIDTH * SCRHEIGHT) / avg;
-	printf( "%5.2fms (%.1ffps) - %.1fMrays/s\n", avg, fps, rps / 1000 );
+	float fps = 1000.0f / avg, rps = raysTraced / avg;
+	printf( "%5.2fms (%.1ffps) - %.1fMrays/s - %.2fM rays, path length %.2f\n", avg, fps, rps / 1000, raysTraced * 1e-6f, avgPathLength );
 	// handle user input
 	camera.HandleInput( deltaTime );
 }
 
+// -----------------------------------------------------------
+// Sprite swarm: galaxian sprites that fly in rings over the
+// world. Each sprite is an instance with its own small grid;
+// only its placement changes from frame to frame.
+// -----------------------------------------------------------
+void Renderer::MoveSwarm( const float deltaTime )
+{
+	if (swarmSize == 0)
+	{
+		const uint model[3] = {
+			scene.instances.AddModel( "assets/galaxian_green.bin" ),
+			scene.instances.AddModel( "assets/galaxian_red.bin" ),
+			scene.instances.AddModel( "assets/galaxian_flag.bin" )
+		};
+		swarmFirst = scene.instances.Count(), swarmSize = 256;
+		for (uint i = 0; i < swarmSize; i++) scene.instances.AddInstance( model[i % 3], float3( 0 ), 0, 0.5f );
+	}
+	swarmTime += deltaTime * 0.001f;
+	for (uint i = 0; i < swarmSize; i++)
+	{
+		// eight rings at different heights, alternating direction
+		const int ring = i & 7;
+		const float a = TWOPI * (i >> 3) / (swarmSize >> 3) + swarmTime * (ring & 1 ? 0.3f : -0.3f);
+		const float r = 0.15f + 0.04f * ring, h = 0.55f + 0.05f * ring + 0.02f * sinf( swarmTime * 2 + i );
+		const int rotation = (int)floorf( a * (2 / PI) + 0.5f ) & 3;
+		scene.instances.Move( swarmFirst + i, float3( 0.5f + r * cosf( a ), h, 0.5f + r * sinf( a ) ), rotation );
+	}
+}
+
+// -----------------------------------------------------------
+// Vehicles: models at arbitrary angles. These do not fit the
+// quarter turns of Move; they are placed with a full transform,
+// which rotates them around their center.
+// -----------------------------------------------------------
+void Renderer::MoveVehicles( const float deltaTime )
+{
+	if (vehicleCount == 0)
+	{
+		const uint model[2] = {
+			scene.instances.AddModel( "assets/corvette.bin" ),
+			scene.instances.AddModel( "assets/legocar.bin" )
+		};
+		vehicleFirst = scene.instances.Count(), vehicleCount = 2;
+		for (uint i = 0; i < vehicleCount; i++) scene.instances.AddInstance( model[i], mat4::Identity() );
+	}
+	vehicleTime += deltaTime * 0.001f;
+	for (uint i = 0; i < vehicleCount; i++)
+	{
+		// a slow turn around the vertical axis, with some roll
+		const Instance& instance = scene.instances.instances[vehicleFirst + i];
+		const int3 size = scene.instances.models[instance.model]->size;
+		const float a = vehicleTime * (i ? -0.5f : 0.7f) + i, roll = 0.3f * sinf( vehicleTime + i );
+		const mat4 M = mat4::Translate( 0.35f + 0.3f * i, 0.6f, 0.5f ) * mat4::RotateY( a ) * mat4::RotateZ( roll ) *
+			mat4::Scale( 0.5f / GRIDSIZE ) * mat4::Translate( float3( size ) * -0.5f );
+		scene.instances.SetTransform( vehicleFirst + i, M );
+	}
+}
+
+// -----------------------------------------------------------
+// Write camera, settings and voxel data to a snapshot; the
+// journal is compacted into it, and its file starts over
+// -----------------------------------------------------------
+void Renderer::SaveState( const char* file )
+{
+	Snapshot snapshot;
+	if (!snapshot.Create( file )) return;
+	stateFile = file;
+	camera.Save( snapshot );
+	snapshot.BeginSection( SECTION_RENDERER, 1 );
+	snapshot.Write( maxBounces ), snapshot.Write( rayBudget );
+	snapshot.Write( cullThreshold ), snapshot.Write( glossiness );
+	snapshot.Write( denoiser.enabled ), snapshot.Write( denoiser.iterations );
+	snapshot.Write( denoiser.sigmaColor ), snapshot.Write( denoiser.sigmaDepth );
+	snapshot.Write( lodBias );
+	snapshot.EndSection();
+	// the voxels, with the journal compacted into them; the journal file is
+	// only started over once the new snapshot replaced the old one
+	if (journalPaused) journal.Restart( scene );
+	journal.Compact( snapshot, scene );
+	if (snapshot.Commit()) journal.Truncate();
+}
+
+// -----------------------------------------------------------
+// Resume from a snapshot; sections that are missing or have an
+// unknown version keep their current state. The voxel data is
+// decoded directly from the mapped file; the journal file with
+// the edits made after it is replayed by Init. Returns false if
+// the snapshot did not contain a usable world.
+// -----------------------------------------------------------
+bool Renderer::RestoreState( const char* file )
+{
+	Snapshot snapshot;
+	if (!snapshot.Open( file )) return false;
+	stateFile = file;
+	camera.Restore( snapshot );
+	uint version;
+	if (snapshot.FindSection( SECTION_RENDERER, version ) && version == 1)
+	{
+		snapshot.Read( maxBounces ), snapshot.Read( rayBudget );
+		snapshot.Read( cullThreshold ), snapshot.Read( glossiness );
+		snapshot.Read( denoiser.enabled ), snapshot.Read( denoiser.iterations );
+		snapshot.Read( denoiser.sigmaColor ), snapshot.Read( denoiser.sigmaDepth );
+		snapshot.Read( lodBias );
+	}
+	SceneFile voxels;
+	if (!snapshot.FindSection( SECTION_VOXELS, version ) || version != 1 || !voxels.Attach( snapshot.section, snapshot.sectionSize )) return false;
+	if (voxels.header->gridSize != GRIDSIZE || voxels.header->brickDim != BRICKDIM) return false;
+	scene.Load( voxels );
+	journal.Restore( snapshot, scene );
+	return true;
+}
+
 // -----------------------------------------------------------
 // Update user interface (imgui)
 // -----------------------------------------------------------
@@ -58,4 +392,85 @@ void Renderer::UI()
 	Ray r = camera.GetPrimaryRay( (float)mousePos.x, (float)mousePos.y );
 	scene.FindNearest( r );
 	ImGui::Text( "voxel: %i", r.voxel );
-}
\ No newline at end of file
+	// asset streaming
+	if (streamer.QueueDepth() || streamer.Pending())
+	{
+		ImGui::Text( "streaming: %i queued, %i bricks pending", streamer.QueueDepth(), streamer.Pending() );
+		ImGui::ProgressBar( streamer.Progress() );
+	}
+	if (streamer.Failed()) ImGui::Text( "assets failed to load: %i", streamer.Failed() );
+	// path tracer settings and statistics
+	ImGui::Text( "emissive voxels: %i, instances: %i", lights.Count(), scene.instances.Count() );
+	ImGui::Text( "rays: %.2fM, avg path length: %.2f", raysTraced * 1e-6f, avgPathLength );
+	ImGui::SliderInt( "max bounces", &maxBounces, 1, 16 );
+	ImGui::SliderInt( "ray budget", &rayBudget, SCRWIDTH * SCRHEIGHT, 16000000 );
+	ImGui::SliderFloat( "glossiness", &glossiness, 0.01f, 0.5f );
+	ImGui::SliderFloat( "lod bias", &lodBias, 0, 4 );
+	// procedural world
+	ImGui::InputInt( "seed", &worldSeed );
+	if (ImGui::Button( "generate" ))
+	{
+		lock_guard<shared_mutex> frame( edits.frameLock );
+		if (paging) pager.Reset( scene, worldSeed ); else generateRate = scene.Generate( worldSeed );
+	}
+	if (generateRate > 0) ImGui::Text( "generated %.1fM voxels/s", generateRate * 1e-6f );
+	if (ImGui::Checkbox( "unbounded world", &paging ) && paging)
+	{
+		lock_guard<shared_mutex> frame( edits.frameLock );
+		pager.Reset( scene, worldSeed );
+	}
+	if (paging)
+	{
+		int budget = (int)(pager.budget >> 20);
+		if (ImGui::SliderInt( "chunk budget (MB)", &budget, 32, 4096 )) pager.budget = (size_t)budget << 20;
+		ImGui::Text( "chunks: %i resident, %i queued", pager.Resident(), pager.Queued() );
+		ImGui::Text( "bricks: %i unique of %i, %iMB (dense: %iMB)", pager.Store().Unique(), pager.Store().References(), (int)(pager.MemoryUsed() >> 20), (int)(pager.DenseSize() >> 20) );
+	}
+	// falling sand and fluids, dropped above the voxel at the center of the screen
+	ImGui::Checkbox( "simulate", &simulate );
+	const bool sand = ImGui::Button( "drop sand" );
+	ImGui::SameLine();
+	const bool water = ImGui::Button( "drop water" );
+	if (sand || water)
+	{
+		Ray center = camera.GetPrimaryRay( SCRWIDTH / 2, SCRHEIGHT / 2 );
+		scene.FindNearest( center );
+		lock_guard<shared_mutex> frame( edits.frameLock );
+		if (center.voxel) scene.FillSphere( center.IntersectionPoint() * GRIDSIZE + float3( 0, 12, 0 ), 5,
+			sand ? SIM_SAND | 0xc2b280 : SIM_FLUID | MATERIAL_GLASS | 0x3060c0 );
+	}
+	// blast a hole at the center of the screen; voxels cut loose become instances
+	if (ImGui::Button( "blast" ))
+	{
+		Ray center = camera.GetPrimaryRay( SCRWIDTH / 2, SCRHEIGHT / 2 );
+		scene.FindNearest( center );
+		lock_guard<shared_mutex> frame( edits.frameLock );
+		if (center.voxel)
+		{
+			const float3 P = center.IntersectionPoint() * GRIDSIZE;
+			const int radius = 10;
+			scene.FillSphere( P, (float)radius, 0 );
+			vector<IslandFinder::Island> found;
+			const int3 p = make_int3( (int)P.x, (int)P.y, (int)P.z );
+			islands.Find( scene, p - radius, p + radius + 1, found );
+			for (const IslandFinder::Island& island : found) IslandFinder::Detach( scene, island );
+			detached = (uint)found.size();
+		}
+	}
+	if (detached) ImGui::Text( "detached %i islands", detached );
+	ImGui::Text( "journal: %i frames with edits, %.1fKB", journal.Frames(), journal.LogSize() / 1024.0f );
+	if (simulate) ImGui::Text( "automaton: %i active bricks, %i changed, %.2fms per step", automaton.Active(), automaton.Changed(), stepTime );
+	// dynamic sprites
+	ImGui::Checkbox( "sprite swarm", &swarm );
+	if (swarm) ImGui::Text( "%i sprites moved in %.3fms", swarmSize, swarmUpdate );
+	ImGui::Checkbox( "vehicles", &vehicles );
+	// replication to viewer processes on this machine
+	bool serve = server.Listening();
+	if (ImGui::Checkbox( "serve viewers", &serve )) { if (serve) server.Listen(); else server.Close(); }
+	if (serve) ImGui::Text( "%i viewers, %.1fKB/s", server.Clients(), server.sendRate / 1024 );
+	if (!client.Connected() && ImGui::Button( "view server" )) client.Connect();
+	if (client.Connected()) ImGui::Text( "viewing: %.1fKB/s, latency %.2fms, applied in %.2fms", client.receiveRate / 1024, client.latency, client.applyTime );
+	// denoiser settings
+	ImGui::Checkbox( "denoise", &denoiser.enabled );
+	ImGui::SliderInt( "filter passes", &denoiser.iterations, 1, 5 );
+}
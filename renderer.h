@@ -3,15 +3,31 @@
 namespace Tmpl8
 {
 
+// per-line bookkeeping for the path tracer: rays reserved from the frame
+// budget, and counters for the statistics
+struct PathState
+{
+	int reserve = 0;		// rays taken from the frame budget but not yet traced
+	uint rays = 0;			// extension and shadow rays traced
+	uint segments = 0;		// summed path length
+	uint paths = 0;
+};
+
 class Renderer : public TheApp
 {
 public:
 	// game flow methods
 	void Init();
-	float3 Trace( Ray& ray, int = 0, int = 0, int = 0 );
+	float3 Trace( Ray& ray );
+	float3 Shade( Ray& ray, PathState& path );
+	bool SpendRay( PathState& path );
 	void Tick( float deltaTime );
+	void MoveSwarm( const float deltaTime );
+	void MoveVehicles( const float deltaTime );
 	void UI();
 	void Shutdown() { /* nothing here for now */ }
+	void SaveState( const char* file );
+	bool RestoreState( const char* file );
 	// input handling
 	void MouseUp( int button ) { button = 0; /* implement if you want to detect mouse button presses */ }
 	void MouseDown( int button ) { button = 0; /* implement if you want to detect mouse button presses */ }
@@ -32,6 +48,44 @@ public:
 	float3* history;		// for episode 5
 	Scene scene;
 	Camera camera;
+	Sky sky;
+	MipVolume mips;
+	LightTree lights;
+	Physics physics;		// collision queries for gameplay code
+	Automaton automaton;	// falling sand and fluids
+	IslandFinder islands;	// voxels cut loose by blasts
+	AssetStreamer streamer;
+	ChunkPager pager;
+	EditQueue edits{ scene };	// for edits from other threads
+	EditJournal journal;	// the edits since the last snapshot
+	string stateFile = "appstate.dat";	// the snapshot of the session; its journal file has ".journal" appended
+	bool journalPaused = false;	// set while paging; the journal does not follow the window
+	ReplicationServer server;	// sends the world to viewer processes
+	ReplicationClient client;	// keeps the world in sync with another process
+	Denoiser denoiser;
+	// path tracer settings and statistics
+	int maxBounces = 8;
+	int rayBudget = 4000000;	// rays per frame, including primary rays
+	float cullThreshold = 0.01f;	// paths with less throughput are terminated
+	float glossiness = 0.15f;	// cone half-angle tangent for MATERIAL_GLOSSY
+	float lodBias = 1;			// instance mip levels: coarse voxels cover up to this many pixels; 0: off
+	int worldSeed = 1;			// for Scene::Generate and the pager
+	bool paging = false;		// unbounded world, see ChunkPager
+	float generateRate = 0;		// voxels per second of the last Generate from the UI
+	bool swarm = false;			// animate the sprite swarm, see MoveSwarm
+	uint swarmFirst = 0, swarmSize = 0;	// instances of the swarm sprites
+	float swarmTime = 0;		// animation time, in seconds
+	float swarmUpdate = 0;		// milliseconds spent in MoveSwarm and the BVH refit, last frame
+	bool vehicles = false;		// tumble the vehicles, see MoveVehicles
+	uint vehicleFirst = 0, vehicleCount = 0;	// instances of the vehicles
+	float vehicleTime = 0;		// animation time, in seconds
+	bool simulate = false;		// step the automaton, at most SIMSTEPS steps per frame
+	float simTime = 0;			// simulated time not yet stepped, in milliseconds
+	float stepTime = 0;			// milliseconds per step, last frame
+	uint detached = 0;			// islands turned into instances by the last blast
+	atomic<int> rayPool;		// rays left in the budget of the current frame
+	uint raysTraced = 0;		// last frame
+	float avgPathLength = 0;	// last frame, in segments per path
 };
 
 } // namespace Tmpl8
\ No newline at end of file
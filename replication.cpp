@@ -0,0 +1,232 @@
+#include "template.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define CloseSocket closesocket
+#define SEND_FLAGS	0
+static bool WouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#define CloseSocket close
+#define SEND_FLAGS	MSG_NOSIGNAL
+static bool WouldBlock() { return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR; }
+#endif
+
+#define MAX_PAYLOAD	(512 << 20)	// a larger message is taken for a damaged stream
+
+static void StartSockets()
+{
+#ifdef _WIN32
+	static bool started = false;
+	if (started) return;
+	WSADATA data;
+	if (WSAStartup( MAKEWORD( 2, 2 ), &data ) != 0) FatalError( "Could not start Winsock" );
+	started = true;
+#endif
+}
+
+static void SetNonBlocking( const intptr_t s )
+{
+	// messages are small and latency matters, so Nagle's algorithm is off too
+	const int one = 1;
+	setsockopt( s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof( one ) );
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket( s, FIONBIO, &mode );
+#else
+	fcntl( (int)s, F_SETFL, fcntl( (int)s, F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+}
+
+static int64_t Now()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Pack( vector<uchar>& out, const uint type, const vector<uchar>& payload )
+{
+	// a header and the deflated payload
+	uLongf bytes = compressBound( (uLong)payload.size() );
+	out.resize( sizeof( ReplicationMessage ) + bytes );
+	compress2( out.data() + sizeof( ReplicationMessage ), &bytes, payload.data(), (uLong)payload.size(), 1 );
+	const ReplicationMessage message = { type, (uint)bytes, (uint)payload.size(), 0, Now() };
+	memcpy( out.data(), &message, sizeof( ReplicationMessage ) );
+	out.resize( sizeof( ReplicationMessage ) + bytes );
+}
+
+bool ReplicationServer::Listen( const ushort port )
+{
+	Close();
+	StartSockets();
+	listener = (intptr_t)::socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if (listener == -1) return false;
+	const int one = 1;
+	setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof( one ) );
+	sockaddr_in address = {};
+	address.sin_family = AF_INET, address.sin_port = htons( port ), address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if (bind( listener, (sockaddr*)&address, sizeof( address ) ) != 0 || listen( listener, 8 ) != 0) { Close(); return false; }
+	SetNonBlocking( listener );
+	rateTimer.reset(), rateBytes = 0;
+	return true;
+}
+
+void ReplicationServer::Close()
+{
+	for (Client& client : clients) CloseSocket( client.socket );
+	clients.clear();
+	if (listener != -1) CloseSocket( listener );
+	listener = -1;
+}
+
+bool ReplicationServer::Flush( Client& client )
+{
+	// send what the socket takes; false if the client is gone
+	size_t done = 0;
+	while (done < client.pending.size())
+	{
+		const int n = send( client.socket, (const char*)client.pending.data() + done, (int)min( client.pending.size() - done, (size_t)1 << 20 ), SEND_FLAGS );
+		if (n < 0 && WouldBlock()) break;
+		if (n <= 0) return false;
+		done += n;
+	}
+	client.pending.erase( client.pending.begin(), client.pending.begin() + done );
+	bytesSent += done, rateBytes += done;
+	return client.pending.size() < REPLICATION_BACKLOG;
+}
+
+void ReplicationServer::Update( const Scene& scene, const EditJournal& journal )
+{
+	if (listener == -1) return;
+	// take in new clients
+	while (1)
+	{
+		const intptr_t s = (intptr_t)accept( listener, 0, 0 );
+		if (s == -1) break;
+		SetNonBlocking( s );
+		clients.push_back( { s, 0, false, {} } );
+	}
+	// queue the world or the missing frames; clients at the same stamp share a message
+	vector<uchar> world, delta, payload;
+	uint deltaSince = 0;
+	const uint newest = journal.frames.empty() ? 0 : journal.frames.back().stamp;
+	for (int i = 0; i < (int)clients.size(); i++)
+	{
+		Client& client = clients[i];
+		if (!client.synced || client.stamp < journal.base)
+		{
+			if (world.empty())
+			{
+				SceneFile::Write( payload, scene.grid );
+				payload.insert( payload.begin(), (const uchar*)&journal.frame, (const uchar*)&journal.frame + sizeof( uint ) );
+				Pack( world, MESSAGE_WORLD, payload );
+			}
+			client.pending.insert( client.pending.end(), world.begin(), world.end() );
+			client.stamp = journal.frame, client.synced = true;
+		}
+		else if (newest > client.stamp)
+		{
+			if (delta.empty() || deltaSince != client.stamp)
+			{
+				journal.Serialize( payload, client.stamp );
+				Pack( delta, MESSAGE_DELTA, payload );
+				deltaSince = client.stamp;
+			}
+			client.pending.insert( client.pending.end(), delta.begin(), delta.end() );
+			client.stamp = journal.frame;
+		}
+		if (!Flush( client ))
+		{
+			CloseSocket( client.socket );
+			clients.erase( clients.begin() + i-- );
+		}
+	}
+	if (rateTimer.elapsed() >= 1) sendRate = rateBytes / rateTimer.elapsed(), rateBytes = 0, rateTimer.reset();
+}
+
+bool ReplicationClient::Connect( const char* host, const ushort port )
+{
+	Close();
+	StartSockets();
+	socket = (intptr_t)::socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if (socket == -1) return false;
+	sockaddr_in address = {};
+	address.sin_family = AF_INET, address.sin_port = htons( port );
+	if (inet_pton( AF_INET, host, &address.sin_addr ) != 1 || connect( socket, (sockaddr*)&address, sizeof( address ) ) != 0) { Close(); return false; }
+	SetNonBlocking( socket );
+	rateTimer.reset(), rateBytes = 0;
+	return true;
+}
+
+void ReplicationClient::Close()
+{
+	if (socket != -1) CloseSocket( socket );
+	socket = -1, synced = false;
+	received.clear();
+}
+
+bool ReplicationClient::Apply( Scene& scene, const ReplicationMessage& message, const uchar* data )
+{
+	// inflate the payload, then load the world or replay the frames
+	payload.resize( message.size );
+	uLongf size = message.size;
+	if (uncompress( payload.data(), &size, data, message.bytes ) != Z_OK || size != message.size) return false;
+	Timer timer;
+	if (message.type == MESSAGE_WORLD)
+	{
+		SceneFile image;
+		if (size < sizeof( uint ) || !image.Attach( payload.data() + sizeof( uint ), size - sizeof( uint ) )) return false;
+		if (image.header->gridSize != GRIDSIZE || image.header->brickDim != BRICKDIM || image.header->brickCount != BRICKCOUNT) return false;
+		scene.Load( image );
+		memcpy( &journal.frame, payload.data(), sizeof( uint ) );
+		journal.Clear();
+		synced = true;
+	}
+	else if (message.type == MESSAGE_DELTA)
+	{
+		const uint since = journal.frame;
+		if (!synced || !journal.Deserialize( payload.data(), size )) return false;
+		journal.Replay( scene, since );
+		journal.Clear();
+	}
+	else return false;
+	applyTime = timer.elapsed() * 1000;
+	latency = (Now() - message.sent) * 0.001f;
+	return true;
+}
+
+bool ReplicationClient::Update( Scene& scene )
+{
+	// receive what arrived, and apply the complete messages; on a damaged
+	// stream or a lost connection, the client disconnects and returns false
+	if (socket == -1) return false;
+	while (1)
+	{
+		const size_t old = received.size();
+		received.resize( old + (1 << 16) );
+		const int n = recv( socket, (char*)received.data() + old, 1 << 16, 0 );
+		received.resize( old + max( n, 0 ) );
+		if (n < 0 && WouldBlock()) break;
+		if (n <= 0) { Close(); return false; }
+		bytesReceived += n, rateBytes += n;
+	}
+	size_t done = 0;
+	while (received.size() - done >= sizeof( ReplicationMessage ))
+	{
+		ReplicationMessage message;
+		memcpy( &message, received.data() + done, sizeof( ReplicationMessage ) );
+		if (message.bytes > MAX_PAYLOAD || message.size > MAX_PAYLOAD) { Close(); return false; }
+		if (received.size() - done - sizeof( ReplicationMessage ) < message.bytes) break;
+		if (!Apply( scene, message, received.data() + done + sizeof( ReplicationMessage ) )) { Close(); return false; }
+		done += sizeof( ReplicationMessage ) + message.bytes;
+	}
+	received.erase( received.begin(), received.begin() + done );
+	if (rateTimer.elapsed() >= 1) receiveRate = rateBytes / rateTimer.elapsed(), rateBytes = 0, rateTimer.reset();
+	return true;
+}
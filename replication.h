@@ -0,0 +1,99 @@
+#pragma once
+
+#define REPLICATION_PORT	7010
+#define REPLICATION_BACKLOG	(64 << 20)	// bytes queued for a client before it is dropped
+
+// message types
+#define MESSAGE_WORLD		1	// a stamp, followed by a scene image, see SceneFile
+#define MESSAGE_DELTA		2	// a serialized EditJournal
+
+namespace Tmpl8 {
+
+// ReplicationMessage: the header of a message between server and client.
+// The payload is deflated with zlib; 'sent' is taken from the steady clock,
+// which all processes on a machine share, for the latency of the client.
+struct ReplicationMessage
+{
+	uint type;
+	uint bytes;					// payload, as sent
+	uint size;					// payload, inflated
+	uint dummy;
+	int64_t sent;				// in microseconds
+};
+
+// ReplicationServer: sends the world to viewer processes as it evolves.
+// A client that connects first receives the world as a scene image, with the
+// stamp of the journal frame it was taken at. After that, it receives the
+// journal frames that it does not have yet, in one message per Update; frames
+// without edits cost nothing. A client that fell behind a compaction of the
+// journal receives the world again. Update is called after EditJournal::Record
+// on the main thread, when the grid matches the journal. Sockets do not
+// block: data that does not fit in the socket buffer waits for the next
+// Update, and a client that has REPLICATION_BACKLOG bytes waiting is dropped.
+// The server only listens on the loopback interface.
+// Only the voxel grid is replicated. Instances, such as detached islands,
+// sprites and vehicles, are not journaled and are not sent; a viewer shows
+// the grid of the server with its own instances, if any.
+class ReplicationServer
+{
+public:
+	ReplicationServer() = default;
+	~ReplicationServer() { Close(); }
+	bool Listen( const ushort port = REPLICATION_PORT );
+	void Close();
+	void Update( const Scene& scene, const EditJournal& journal );
+	bool Listening() const { return listener != -1; }
+	uint Clients() const { return (uint)clients.size(); }
+	// statistics
+	uint64_t bytesSent = 0;
+	float sendRate = 0;			// bytes per second, over the last second
+private:
+	struct Client
+	{
+		intptr_t socket;
+		uint stamp;				// last frame sent
+		bool synced;			// the world was sent
+		vector<uchar> pending;	// waiting for the socket
+	};
+	bool Flush( Client& client );
+	intptr_t listener = -1;
+	vector<Client> clients;
+	uint64_t rateBytes = 0;
+	Timer rateTimer;
+};
+
+// ReplicationClient: keeps a world in sync with a ReplicationServer.
+// Update is called between frames; it takes in the messages that arrived
+// since the last call, loads the world or replays the deltas, and marks the
+// changed bricks dirty, as a local edit would. The client has its own journal
+// for the deltas, so that the journal of the viewer can record a session.
+// That journal has no shadow, and drops the frames once they are replayed;
+// only its stamp is kept.
+class ReplicationClient
+{
+public:
+	ReplicationClient() = default;
+	~ReplicationClient() { Close(); }
+	bool Connect( const char* host = "127.0.0.1", const ushort port = REPLICATION_PORT );
+	void Close();
+	bool Update( Scene& scene );
+	bool Connected() const { return socket != -1; }
+	bool Synced() const { return synced; }
+	uint Stamp() const { return journal.frame; }	// of the last frame applied
+	// statistics
+	uint64_t bytesReceived = 0;
+	float receiveRate = 0;		// bytes per second, over the last second
+	float latency = 0;			// milliseconds from sending to applying, last message
+	float applyTime = 0;		// milliseconds spent applying, last message
+private:
+	bool Apply( Scene& scene, const ReplicationMessage& message, const uchar* data );
+	intptr_t socket = -1;
+	bool synced = false;
+	EditJournal journal;		// stamp of the server's world; never Reset
+	vector<uchar> received;		// data of incomplete messages
+	vector<uchar> payload;		// inflated
+	uint64_t rateBytes = 0;
+	Timer rateTimer;
+};
+
+} // namespace Tmpl8
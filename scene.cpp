@@ -25,26 +25,402 @@ Scene::Scene()
 	// allocate room for the world
 	grid = (uint*)MALLOC64( GRIDSIZE3 * sizeof( uint ) );
 	memset( grid, 0, GRIDSIZE3 * sizeof( uint ) );
-	// initialize the scene using Perlin noise, parallel over z
-#pragma omp parallel for schedule(dynamic)
-	for (int z = 0; z < 128; z++)
+	dirty = (atomic<uchar>*)MALLOC64( BRICKCOUNT );
+	memset( dirty, 0, BRICKCOUNT );
+	edited = false;
+}
+
+// seeded 3D gradient noise for 8 points at once. Lattice points are hashed
+// with integer arithmetic rather than a permutation table, which avoids
+// gathers and makes the seed a simple input of the hash.
+static inline __m256i Hash8( const __m256i h )
+{
+	const __m256i a = _mm256_xor_si256( h, _mm256_srli_epi32( h, 15 ) );
+	const __m256i b = _mm256_mullo_epi32( a, _mm256_set1_epi32( 0x2c1b3c6d ) );
+	return _mm256_xor_si256( b, _mm256_srli_epi32( b, 13 ) );
+}
+static inline __m256 Gradient8( const __m256i h, const __m256 x, const __m256 y, const __m256 z )
+{
+	// Perlin's 12 gradient directions, selected by the low 4 bits of the hash
+	const __m256i h4 = _mm256_and_si256( h, _mm256_set1_epi32( 15 ) );
+	const __m256 useX = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( 8 ), h4 ) );
+	const __m256 useY = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( 4 ), h4 ) );
+	const __m256 useX2 = _mm256_castsi256_ps( _mm256_cmpeq_epi32( _mm256_or_si256( h4, _mm256_set1_epi32( 2 ) ), _mm256_set1_epi32( 14 ) ) );
+	const __m256 u = _mm256_blendv_ps( y, x, useX );
+	const __m256 v = _mm256_blendv_ps( _mm256_blendv_ps( z, x, useX2 ), y, useY );
+	const __m256 su = _mm256_castsi256_ps( _mm256_slli_epi32( h, 31 ) );
+	const __m256 sv = _mm256_castsi256_ps( _mm256_slli_epi32( _mm256_srli_epi32( h, 1 ), 31 ) );
+	return _mm256_add_ps( _mm256_xor_ps( u, su ), _mm256_xor_ps( v, sv ) );
+}
+static inline __m256 Fade8( const __m256 t )
+{
+	// 6t^5 - 15t^4 + 10t^3
+	const __m256 p = _mm256_fmadd_ps( t, _mm256_set1_ps( 6 ), _mm256_set1_ps( -15 ) );
+	return _mm256_mul_ps( _mm256_mul_ps( t, _mm256_mul_ps( t, t ) ), _mm256_fmadd_ps( t, p, _mm256_set1_ps( 10 ) ) );
+}
+static inline __m256 Lerp8( const __m256 t, const __m256 a, const __m256 b )
+{
+	return _mm256_fmadd_ps( t, _mm256_sub_ps( b, a ), a );
+}
+static __m256 GradientNoise8( const uint seed, const __m256 x, const __m256 y, const __m256 z )
+{
+	const __m256 fx = _mm256_floor_ps( x ), fy = _mm256_floor_ps( y ), fz = _mm256_floor_ps( z );
+	const __m256 dx = _mm256_sub_ps( x, fx ), dy = _mm256_sub_ps( y, fy ), dz = _mm256_sub_ps( z, fz );
+	const __m256 one = _mm256_set1_ps( 1 );
+	const __m256 ex = _mm256_sub_ps( dx, one ), ey = _mm256_sub_ps( dy, one ), ez = _mm256_sub_ps( dz, one );
+	// per-axis hash terms of the two lattice planes around each point
+	const __m256i P1 = _mm256_set1_epi32( (int)0x8da6b343 ), P2 = _mm256_set1_epi32( (int)0xd8163841 ), P3 = _mm256_set1_epi32( (int)0xcb1ab31f );
+	const __m256i hx0 = _mm256_mullo_epi32( _mm256_cvtps_epi32( fx ), P1 ), hx1 = _mm256_add_epi32( hx0, P1 );
+	const __m256i hy0 = _mm256_mullo_epi32( _mm256_cvtps_epi32( fy ), P2 ), hy1 = _mm256_add_epi32( hy0, P2 );
+	const __m256i hz0 = _mm256_xor_si256( _mm256_mullo_epi32( _mm256_cvtps_epi32( fz ), P3 ), _mm256_set1_epi32( (int)seed ) );
+	const __m256i hz1 = _mm256_xor_si256( _mm256_add_epi32( _mm256_mullo_epi32( _mm256_cvtps_epi32( fz ), P3 ), P3 ), _mm256_set1_epi32( (int)seed ) );
+	const __m256i h00 = _mm256_xor_si256( hy0, hz0 ), h10 = _mm256_xor_si256( hy1, hz0 );
+	const __m256i h01 = _mm256_xor_si256( hy0, hz1 ), h11 = _mm256_xor_si256( hy1, hz1 );
+	// gradients at the 8 corners, blended with the fade curve
+	const __m256 ux = Fade8( dx ), uy = Fade8( dy ), uz = Fade8( dz );
+	const __m256 n000 = Gradient8( Hash8( _mm256_xor_si256( hx0, h00 ) ), dx, dy, dz );
+	const __m256 n100 = Gradient8( Hash8( _mm256_xor_si256( hx1, h00 ) ), ex, dy, dz );
+	const __m256 n010 = Gradient8( Hash8( _mm256_xor_si256( hx0, h10 ) ), dx, ey, dz );
+	const __m256 n110 = Gradient8( Hash8( _mm256_xor_si256( hx1, h10 ) ), ex, ey, dz );
+	const __m256 n001 = Gradient8( Hash8( _mm256_xor_si256( hx0, h01 ) ), dx, dy, ez );
+	const __m256 n101 = Gradient8( Hash8( _mm256_xor_si256( hx1, h01 ) ), ex, dy, ez );
+	const __m256 n011 = Gradient8( Hash8( _mm256_xor_si256( hx0, h11 ) ), dx, ey, ez );
+	const __m256 n111 = Gradient8( Hash8( _mm256_xor_si256( hx1, h11 ) ), ex, ey, ez );
+	const __m256 n00 = Lerp8( ux, n000, n100 ), n10 = Lerp8( ux, n010, n110 );
+	const __m256 n01 = Lerp8( ux, n001, n101 ), n11 = Lerp8( ux, n011, n111 );
+	return Lerp8( uz, Lerp8( uy, n00, n10 ), Lerp8( uy, n01, n11 ) );
+}
+
+void Scene::GenerateBlock( uint* dest, const int3 origin, const int dim, const int strideY, const int strideZ, const uint seed )
+{
+	// fractal gradient noise, thresholded, for a cube of dim^3 voxels at
+	// 'origin', in grid coordinates; these may lie outside the grid. Lines of 8
+	// voxels are evaluated at once, so dim must be a multiple of 8, and 'dest'
+	// must be 32-byte aligned, as must the strides. The result only depends on
+	// the seed and the voxel positions.
+	const int OCTAVES = 3;
+	for (int z = 0; z < dim; z++) for (int y = 0; y < dim; y++)
 	{
-		const float fz = (float)z / WORLDSIZE;
-		for (int y = 0; y < WORLDSIZE; y++)
+		const int wy = clamp( origin.y + y, 0, GRIDSIZE - 1 );
+		const __m256i color = _mm256_set1_epi32( 0x020101 * (wy * 128 / GRIDSIZE) );
+		const __m256 fy = _mm256_set1_ps( (float)(origin.y + y) / GRIDSIZE ), fz = _mm256_set1_ps( (float)(origin.z + z) / GRIDSIZE );
+		for (int x = 0; x < dim; x += 8)
 		{
-			float fx = 0, fy = (float)y / WORLDSIZE;
-			for (int x = 0; x < WORLDSIZE; x++, fx += 1.0f / WORLDSIZE)
+			const __m256 fx = _mm256_mul_ps( _mm256_add_ps( _mm256_set1_ps( (float)(origin.x + x) ), _mm256_setr_ps( 0, 1, 2, 3, 4, 5, 6, 7 ) ), _mm256_set1_ps( 1.0f / GRIDSIZE ) );
+			__m256 n = _mm256_setzero_ps();
+			float frequency = 5, amplitude = 0.5f;
+			for (int i = 0; i < OCTAVES; i++, frequency *= 2, amplitude *= 0.5f)
 			{
-				const float n = noise3D( fx, fy, fz );
-				Set( x, y, z, n > 0.09f ? 0x020101 * y : 0 );
+				const __m256 f = _mm256_set1_ps( frequency );
+				const __m256 o = GradientNoise8( seed + i, _mm256_mul_ps( fx, f ), _mm256_mul_ps( fy, f ), _mm256_mul_ps( fz, f ) );
+				n = _mm256_fmadd_ps( o, _mm256_set1_ps( amplitude ), n );
 			}
+			const __m256i solid = _mm256_castps_si256( _mm256_cmp_ps( n, _mm256_set1_ps( GENERATE_THRESHOLD ), _CMP_GT_OQ ) );
+			_mm256_store_si256( (__m256i*)(dest + x + y * strideY + z * strideZ), _mm256_and_si256( solid, color ) );
 		}
 	}
 }
 
+float Scene::Generate( const uint seed )
+{
+	// the world is generated brick by brick, in parallel, so that each task
+	// writes a compact block of memory. Returns the generation speed in voxels
+	// per second.
+	Timer timer;
+#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < BRICKCOUNT; b++)
+	{
+		const int3 brick = make_int3( b % GRIDBRICKS, (b / GRIDBRICKS) % GRIDBRICKS, b / GRIDBRICKS2 ) * BRICKDIM;
+		GenerateBlock( grid + brick.x + brick.y * GRIDSIZE + brick.z * GRIDSIZE2, brick, BRICKDIM, GRIDSIZE, GRIDSIZE2, seed );
+	}
+	MarkDirty( make_int3( 0 ), make_int3( GRIDSIZE ) );
+	return GRIDSIZE3 / timer.elapsed();
+}
+
 void Scene::Set( const uint x, const uint y, const uint z, const uint v )
 {
 	grid[x + y * GRIDSIZE + z * GRIDSIZE2] = v;
+	// track modified bricks so that derived data can be updated incrementally
+	MarkDirty( BrickIndex( x, y, z ) );
+}
+
+bool ModelReader::Open( const char* fileName, const int3 position, const int quarterTurns, const bool clip )
+{
+	Close();
+	offset = position, rotation = quarterTurns & 3, clipToWorld = clip;
+	first = count = i = 0, block = 0, truncated = false;
+	if (blocked.Open( fileName ))
+	{
+		// a block model: blocks are inflated one by one in Next
+		sx = blocked.header->sx, sy = blocked.header->sy, sz = blocked.header->sz, voxels = sx * sy * sz;
+		chunk = (uint*)MALLOC64( blocked.header->blockVoxels * sizeof( uint ) );
+		return true;
+	}
+	file = gzopen( fileName, "rb" );
+	if (!file) return false;
+	gzbuffer( file, CHUNKSIZE * sizeof( uint ) );
+	uint size[3];
+	if (gzread( file, size, sizeof( size ) ) != sizeof( size )) { Close(); return false; }
+	sx = size[0], sy = size[1], sz = size[2], voxels = sx * sy * sz;
+	chunk = (uint*)MALLOC64( CHUNKSIZE * sizeof( uint ) );
+	return true;
+}
+
+void ModelReader::Close()
+{
+	if (file) gzclose( file );
+	FREE64( chunk );
+	blocked.Close();
+	file = 0, chunk = 0;
+}
+
+static inline void RotateModelVoxel( const uint idx, const uint sx, const uint sy, const uint sz, const int rotation, uint& x, uint& y, uint& z )
+{
+	// model position of voxel 'idx', turned a number of quarter turns around the y-axis
+	const uint mx = idx % sx, my = (idx / sx) % sy, mz = idx / (sx * sy);
+	x = mx, y = my, z = mz;
+	switch (rotation)
+	{
+	case 1: x = sz - 1 - mz, z = mx; break;
+	case 2: x = sx - 1 - mx, z = sz - 1 - mz; break;
+	case 3: x = mz, z = sx - 1 - mx; break;
+	}
+}
+
+bool ModelReader::Next( uint& x, uint& y, uint& z, uint& v )
+{
+	while (1)
+	{
+		if (i == count)
+		{
+			// inflate the next chunk
+			first += count, count = i = 0;
+			if (first >= voxels) return false;
+			if (file)
+			{
+				count = min( (uint)CHUNKSIZE, voxels - first );
+				if (gzread( file, chunk, count * sizeof( uint ) ) != (int)(count * sizeof( uint ))) { truncated = true; return false; }
+				for (uint j = 0; j < count; j++) chunk[j] &= MODEL_ALBEDO;
+			}
+			else
+			{
+				count = blocked.Voxels( block );
+				if (!blocked.Inflate( block++, chunk )) { count = 0, truncated = true; return false; }
+			}
+		}
+		// skip empty runs 8 voxels at a time
+		if ((i & 7) == 0 && i + 8 <= count)
+		{
+			const __m256i v8 = _mm256_load_si256( (__m256i*)(chunk + i) );
+			if (_mm256_testz_si256( v8, v8 )) { i += 8; continue; }
+		}
+		const uint idx = first + i;
+		v = chunk[i++];
+		if (!v) continue;
+		RotateModelVoxel( idx, sx, sy, sz, rotation, x, y, z );
+		x += offset.x, y += offset.y, z += offset.z;
+		if (!clipToWorld || (x < GRIDSIZE && y < GRIDSIZE && z < GRIDSIZE)) return true;
+	}
+}
+
+static inline void FillRow( uint* row, const int count, const uint v )
+{
+	// vectorised fill of 'count' voxels
+	const __m256i v8 = _mm256_set1_epi32( v );
+	int x = 0;
+	for (; x + 8 <= count; x += 8) _mm256_storeu_si256( (__m256i*)(row + x), v8 );
+	for (; x < count; x++) row[x] = v;
+}
+
+void Scene::FillBox( const int3 bmin, const int3 bmax, const uint v )
+{
+	// set voxels [bmin, bmax), clipped to the world; use 0 to carve
+	const int3 lo = max( bmin, make_int3( 0 ) ), hi = min( bmax, make_int3( GRIDSIZE ) );
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+	for (int z = lo.z; z < hi.z; z++) for (int y = lo.y; y < hi.y; y++)
+		FillRow( grid + lo.x + y * GRIDSIZE + z * GRIDSIZE2, hi.x - lo.x, v );
+	MarkDirty( lo, hi );
+}
+
+void Scene::FillSphere( const float3& center, const float radius, const uint v )
+{
+	// set the voxels whose center lies in the sphere; center and radius are in
+	// voxels. Each line of voxels is a single span, filled at once.
+	const int3 lo = max( make_int3( (int)floorf( center.x - radius ), (int)floorf( center.y - radius ), (int)floorf( center.z - radius ) ), make_int3( 0 ) );
+	const int3 hi = min( make_int3( (int)ceilf( center.x + radius ), (int)ceilf( center.y + radius ), (int)ceilf( center.z + radius ) ) + 1, make_int3( GRIDSIZE ) );
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+	for (int z = lo.z; z < hi.z; z++) for (int y = lo.y; y < hi.y; y++)
+	{
+		const float dy = y + 0.5f - center.y, dz = z + 0.5f - center.z, h2 = radius * radius - dy * dy - dz * dz;
+		if (h2 < 0) continue;
+		const float h = sqrtf( h2 );
+		const int x0 = max( 0, (int)ceilf( center.x - h - 0.5f ) ), x1 = min( GRIDSIZE - 1, (int)floorf( center.x + h - 0.5f ) );
+		if (x0 <= x1) FillRow( grid + x0 + y * GRIDSIZE + z * GRIDSIZE2, x1 - x0 + 1, v );
+	}
+	MarkDirty( lo, hi );
+}
+
+void Scene::CopyRegion( const int3 src, const int3 size, const int3 dst )
+{
+	// copy a box of voxels to another position in the world; the boxes may
+	// overlap. Parts that fall outside the world on either side are skipped.
+	const int3 lo = max( max( make_int3( 0 ) - src, make_int3( 0 ) - dst ), make_int3( 0 ) );
+	const int3 hi = min( min( make_int3( GRIDSIZE ) - src, make_int3( GRIDSIZE ) - dst ), size );
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+	// walk the lines in the order that reads each source line before it is overwritten
+	const bool backwards = dst.z > src.z || (dst.z == src.z && dst.y > src.y);
+	const int lines = (hi.y - lo.y) * (hi.z - lo.z);
+	for (int i = 0; i < lines; i++)
+	{
+		const int j = backwards ? lines - 1 - i : i;
+		const int y = lo.y + j % (hi.y - lo.y), z = lo.z + j / (hi.y - lo.y);
+		memmove( grid + dst.x + lo.x + (dst.y + y) * GRIDSIZE + (dst.z + z) * GRIDSIZE2,
+			grid + src.x + lo.x + (src.y + y) * GRIDSIZE + (src.z + z) * GRIDSIZE2, (hi.x - lo.x) * sizeof( uint ) );
+	}
+	MarkDirty( dst + lo, dst + hi );
+}
+
+void Scene::PasteModel( const VoxelModel& model, const int3 offset )
+{
+	// merge a model into the world: empty model voxels keep the world's voxel.
+	// Lines are blended 8 voxels at a time.
+	const int3 lo = max( make_int3( 0 ) - offset, make_int3( 0 ) ), hi = min( make_int3( GRIDSIZE ) - offset, model.size );
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+	const __m256i zero = _mm256_setzero_si256();
+	for (int z = lo.z; z < hi.z; z++) for (int y = lo.y; y < hi.y; y++)
+	{
+		const uint* src = model.voxels + y * model.size.x + z * model.size.x * model.size.y;
+		uint* dest = grid + offset.x + (offset.y + y) * GRIDSIZE + (offset.z + z) * GRIDSIZE2;
+		int x = lo.x;
+		for (; x + 8 <= hi.x; x += 8)
+		{
+			const __m256i s8 = _mm256_loadu_si256( (const __m256i*)(src + x) );
+			const __m256i d8 = _mm256_loadu_si256( (const __m256i*)(dest + x) );
+			_mm256_storeu_si256( (__m256i*)(dest + x), _mm256_blendv_epi8( s8, d8, _mm256_cmpeq_epi32( s8, zero ) ) );
+		}
+		for (; x < hi.x; x++) if (src[x]) dest[x] = src[x];
+	}
+	MarkDirty( offset + lo, offset + hi );
+}
+
+void Scene::SubtractModel( const VoxelModel& model, const int3 offset )
+{
+	// carve a model out of the world: world voxels under solid model voxels are
+	// cleared, as with PasteModel, 8 voxels at a time
+	const int3 lo = max( make_int3( 0 ) - offset, make_int3( 0 ) ), hi = min( make_int3( GRIDSIZE ) - offset, model.size );
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+	const __m256i zero = _mm256_setzero_si256();
+	for (int z = lo.z; z < hi.z; z++) for (int y = lo.y; y < hi.y; y++)
+	{
+		const uint* src = model.voxels + y * model.size.x + z * model.size.x * model.size.y;
+		uint* dest = grid + offset.x + (offset.y + y) * GRIDSIZE + (offset.z + z) * GRIDSIZE2;
+		int x = lo.x;
+		for (; x + 8 <= hi.x; x += 8)
+		{
+			const __m256i s8 = _mm256_loadu_si256( (const __m256i*)(src + x) );
+			const __m256i d8 = _mm256_loadu_si256( (const __m256i*)(dest + x) );
+			_mm256_storeu_si256( (__m256i*)(dest + x), _mm256_and_si256( d8, _mm256_cmpeq_epi32( s8, zero ) ) );
+		}
+		for (; x < hi.x; x++) if (src[x]) dest[x] = 0;
+	}
+	MarkDirty( offset + lo, offset + hi );
+}
+
+void Scene::LoadModel( const char* file, const int3 offset, const int rotation )
+{
+	// stream a model into the grid, see ModelReader. Empty voxels are skipped,
+	// so the model merges with what is already there.
+	BlockModel blocked;
+	if (blocked.Open( file ))
+	{
+		// a block model is inflated on all cores; blocks write disjoint voxels
+		const BlockModel::Header& h = *blocked.header;
+		atomic<bool> damaged = false;
+	#pragma omp parallel
+		{
+			uint* voxels = (uint*)MALLOC64( h.blockVoxels * sizeof( uint ) );
+		#pragma omp for schedule(dynamic)
+			for (int b = 0; b < (int)h.blockCount; b++)
+			{
+				if (!blocked.Inflate( b, voxels )) { damaged = true; continue; }
+				const uint first = b * h.blockVoxels, count = blocked.Voxels( b );
+				for (uint i = 0; i < count; i++)
+				{
+					if ((i & 7) == 0 && i + 8 <= count)
+					{
+						const __m256i v8 = _mm256_load_si256( (__m256i*)(voxels + i) );
+						if (_mm256_testz_si256( v8, v8 )) { i += 7; continue; }
+					}
+					if (!voxels[i]) continue;
+					uint x, y, z;
+					RotateModelVoxel( first + i, h.sx, h.sy, h.sz, rotation & 3, x, y, z );
+					x += offset.x, y += offset.y, z += offset.z;
+					if (x < GRIDSIZE && y < GRIDSIZE && z < GRIDSIZE) grid[x + y * GRIDSIZE + z * GRIDSIZE2] = voxels[i];
+				}
+			}
+			FREE64( voxels );
+		}
+		if (damaged) FatalError( "Damaged model file: %s", file );
+		// the bricks covered by the rotated model bounds
+		const int3 size = rotation & 1 ? make_int3( h.sz, h.sy, h.sx ) : make_int3( h.sx, h.sy, h.sz );
+		MarkDirty( offset, offset + size );
+		return;
+	}
+	ModelReader model;
+	if (!model.Open( file, offset, rotation )) FatalError( "Could not load model %s", file );
+	uint x, y, z, v;
+	while (model.Next( x, y, z, v ))
+	{
+		grid[x + y * GRIDSIZE + z * GRIDSIZE2] = v;
+		MarkDirty( BrickIndex( x, y, z ) );
+	}
+	if (model.truncated) FatalError( "Truncated model file: %s", file );
+}
+
+void Scene::Save( const char* file ) const
+{
+	// store the world in the native format, see scenefile.h
+	SceneFile::Save( file, grid );
+}
+
+bool Scene::Load( const char* file )
+{
+	// replace the world with a scene saved by Scene::Save; the file is mapped,
+	// and bricks are decoded in parallel
+	SceneFile source;
+	if (!source.Open( file )) return false;
+	if (source.header->gridSize != GRIDSIZE || source.header->brickDim != BRICKDIM || source.header->brickCount != BRICKCOUNT)
+		FatalError( "Scene %s has size %i, expected %i", file, source.header->gridSize, GRIDSIZE );
+	Load( source );
+	return true;
+}
+
+void Scene::Load( const SceneFile& source )
+{
+	// decode all bricks of a validated scene image
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < BRICKCOUNT; i++)
+	{
+		const int x = (i % GRIDBRICKS) * BRICKDIM, y = ((i / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM, z = (i / GRIDBRICKS2) * BRICKDIM;
+		source.DecodeBrick( i, grid + x + y * GRIDSIZE + z * GRIDSIZE2, GRIDSIZE, GRIDSIZE2 );
+	}
+	MarkDirty( make_int3( 0 ), make_int3( GRIDSIZE ) );
+}
+
+void Scene::MarkDirty( const int3 bmin, const int3 bmax )
+{
+	// mark the bricks that overlap voxels [bmin, bmax), clipped to the world
+	const int3 lo = max( bmin, make_int3( 0 ) ), hi = min( bmax, make_int3( GRIDSIZE ) ) + (BRICKDIM - 1);
+	for (int z = lo.z / BRICKDIM; z < hi.z / BRICKDIM; z++) for (int y = lo.y / BRICKDIM; y < hi.y / BRICKDIM; y++)
+		for (int x = lo.x / BRICKDIM; x < hi.x / BRICKDIM; x++) MarkDirty( x + y * GRIDBRICKS + z * GRIDBRICKS2 );
+}
+
+void Scene::ClearDirty()
+{
+	// only the listed bricks have their flag set
+	for (const uint brick : dirtyBricks) dirty[brick] = 0;
+	dirtyBricks.clear();
+	edited = false;
 }
 
 bool Scene::Setup3DDDA( Ray& ray, DDAState& state ) const
@@ -74,6 +450,22 @@ bool Scene::Setup3DDDA( Ray& ray, DDAState& state ) const
 }
 
 void Scene::FindNearest( Ray& ray ) const
+{
+	// nearest hit in the world grid, then in the instances, which may be closer
+	const float rayLength = ray.t;
+	FindNearestInGrid( ray );
+	if (instances.Count() == 0 || ray.inside) return;
+	if (ray.voxel == 0) ray.t = rayLength;
+	instances.FindNearest( ray );
+}
+
+bool Scene::IsOccluded( Ray& ray ) const
+{
+	if (IsOccludedInGrid( ray )) return true;
+	return instances.Count() > 0 && instances.IsOccluded( ray );
+}
+
+void Scene::FindNearestInGrid( Ray& ray ) const
 {
 	// nudge origin
 	ray.O += EPSILON * ray.D;
@@ -125,7 +517,7 @@ void Scene::FindNearest( Ray& ray ) const
 	ray.axis = axis;
 }
 
-bool Scene::IsOccluded( Ray& ray ) const
+bool Scene::IsOccludedInGrid( Ray& ray ) const
 {
 	// nudge origin
 	ray.O += EPSILON * ray.D;
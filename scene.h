@@ -9,11 +9,52 @@
 #define GRIDSIZE2	(GRIDSIZE*GRIDSIZE)
 #define GRIDSIZE3	(GRIDSIZE*GRIDSIZE*GRIDSIZE)
 
+// bricks: 8x8x8 voxel blocks, the unit of change tracking
+#define BRICKDIM	8
+#define BRICKSIZE	(BRICKDIM*BRICKDIM*BRICKDIM)
+#define GRIDBRICKS	(GRIDSIZE/BRICKDIM)
+#define GRIDBRICKS2	(GRIDBRICKS*GRIDBRICKS)
+#define BRICKCOUNT	(GRIDBRICKS*GRIDBRICKS*GRIDBRICKS)
+
 // epsilon
 #define EPSILON		0.00001f
 
+// procedural world: noise values above this threshold are solid
+#define GENERATE_THRESHOLD	0.1f
+
 namespace Tmpl8 {
 
+// ModelReader: streams the non-empty voxels of a gzip-compressed .bin model.
+// The file holds the model size (3 uints), followed by x * y * z uint voxels,
+// x fastest; only their albedo is used, see MODEL_ALBEDO. Voxels are inflated in fixed-size chunks, so the full model is
+// never held in memory. Positions are returned in grid coordinates: rotated by
+// a number of quarter turns around the y-axis and placed at 'offset'. Unless
+// 'clip' is false, voxels that fall outside the world are skipped.
+// Block models (.vxb, see BlockModel) are read one block at a time.
+class ModelReader
+{
+public:
+	enum { CHUNKSIZE = 16384 }; // voxels
+	ModelReader() = default;
+	~ModelReader() { Close(); }
+	bool Open( const char* fileName, const int3 position, const int quarterTurns = 0, const bool clip = true );
+	void Close();
+	bool Next( uint& x, uint& y, uint& z, uint& v );
+	float Progress() const { return voxels ? (float)first / voxels : 1; }
+	// data members
+	uint sx = 0, sy = 0, sz = 0;	// model size
+	bool truncated = false;			// set by Next if the file ended early
+private:
+	gzFile file = 0;
+	BlockModel blocked;				// used instead of 'file' for a block model
+	int block = 0;					// next block to inflate
+	uint* chunk = 0;
+	uint voxels = 0, first = 0, count = 0, i = 0;
+	int3 offset = make_int3( 0 );
+	int rotation = 0;
+	bool clipToWorld = true;
+};
+
 class Scene
 {
 public:
@@ -26,12 +67,47 @@ public:
 		float3 tmax;
 	};
 	Scene();
+	float Generate( const uint seed = 1 );
+	static void GenerateBlock( uint* dest, const int3 origin, const int dim, const int strideY, const int strideZ, const uint seed );
 	void FindNearest( Ray& ray ) const;
 	bool IsOccluded( Ray& ray ) const;
-	void Set( const uint x, const uint y, const uint z, const uint v );
+	void Set( const uint x, const uint y, const uint z, const uint v );	// thread-safe for distinct voxels
+	void LoadModel( const char* file, const int3 offset, const int rotation = 0 );
+	// bulk edits; coordinates are in voxels, and edits are clipped to the world.
+	// PasteModel and SubtractModel are CSG union and difference with a model.
+	void FillBox( const int3 bmin, const int3 bmax, const uint v );
+	void FillSphere( const float3& center, const float radius, const uint v );
+	void CopyRegion( const int3 src, const int3 size, const int3 dst );
+	void PasteModel( const VoxelModel& model, const int3 offset );
+	void SubtractModel( const VoxelModel& model, const int3 offset );
+	void Save( const char* file ) const;
+	bool Load( const char* file );
+	void Load( const SceneFile& source );
+	static uint BrickIndex( const uint x, const uint y, const uint z )
+	{
+		return (x / BRICKDIM) + (y / BRICKDIM) * GRIDBRICKS + (z / BRICKDIM) * GRIDBRICKS2;
+	}
+	void MarkDirty( const uint brick )
+	{
+		// may be called from several threads at once, e.g. by Set in an OpenMP
+		// loop: the thread that raises the flag of a brick adds it to the list
+		if (dirty[brick].load( memory_order_relaxed ) || dirty[brick].exchange( 1 )) return;
+		lock_guard<mutex> guard( dirtyLock );
+		dirtyBricks.push_back( brick );
+		edited = true;
+	}
+	void MarkDirty( const int3 bmin, const int3 bmax );
+	void ClearDirty();
 	unsigned int* grid; // voxel payload is 'unsigned int', interpretation of the bits is free!
+	atomic<uchar>* dirty;	// per brick: 1 if modified since the last ClearDirty
+	vector<uint> dirtyBricks;	// the bricks with a dirty flag, for incremental updates
+	bool edited;		// true if any brick is dirty
+	TopLevelBVH instances;	// instanced models, traced along with the grid
 private:
+	mutex dirtyLock;	// guards dirtyBricks and edited in MarkDirty
 	bool Setup3DDDA( Ray& ray, DDAState& state ) const;
+	void FindNearestInGrid( Ray& ray ) const;
+	bool IsOccludedInGrid( Ray& ray ) const;
 };
 
 }
\ No newline at end of file
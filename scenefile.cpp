@@ -0,0 +1,159 @@
+#include "template.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open( const char* file )
+{
+	Close();
+#ifdef _WIN32
+	HANDLE handle = CreateFileA( file, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx( handle, &fileSize );
+	HANDLE mapping = fileSize.QuadPart ? CreateFileMappingA( handle, 0, PAGE_READONLY, 0, 0, 0 ) : 0;
+	CloseHandle( handle ); // the mapping keeps the file open
+	if (!mapping) return false;
+	data = (const uchar*)MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping ); // the view keeps the mapping alive
+	if (!data) return false;
+	size = (size_t)fileSize.QuadPart;
+#else
+	const int fd = open( file, O_RDONLY );
+	if (fd < 0) return false;
+	struct stat info;
+	void* view = fstat( fd, &info ) == 0 && info.st_size > 0 ? mmap( 0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) : MAP_FAILED;
+	close( fd ); // the mapping keeps the file open
+	if (view == MAP_FAILED) return false;
+	data = (const uchar*)view, size = info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (!data) return;
+#ifdef _WIN32
+	UnmapViewOfFile( data );
+#else
+	munmap( (void*)data, size );
+#endif
+	data = 0, size = 0;
+}
+
+bool SceneFile::Open( const char* file )
+{
+	// map the file read-only
+	Close();
+	if (!mapped.Open( file )) return false;
+	if (Attach( mapped.data, mapped.size )) return true;
+	mapped.Close();
+	return false;
+}
+
+bool SceneFile::Attach( const uchar* image, const size_t bytes )
+{
+	// use a scene image in memory; the directory is validated, bricks are not
+	header = (const Header*)image;
+	directory = (const Entry*)(image + sizeof( Header ));
+	bool valid = bytes >= sizeof( Header ) && header->magic == SCENEFILE_MAGIC && header->version == SCENEFILE_VERSION;
+	valid = valid && bytes >= sizeof( Header ) + header->brickCount * sizeof( Entry );
+	for (uint i = 0; valid && i < header->brickCount; i++)
+		valid = directory[i].offset + directory[i].words * sizeof( uint ) <= bytes;
+	if (valid) base = image, size = bytes; else header = 0, directory = 0;
+	return valid;
+}
+
+void SceneFile::Close()
+{
+	mapped.Close();
+	base = 0, header = 0, directory = 0, size = 0;
+}
+
+void SceneFile::DecodeBrick( const int brick, uint* dest, const uint strideY, const uint strideZ ) const
+{
+	// decode a brick to 'dest', its first voxel; the strides are in voxels, so
+	// this writes into the scene grid as well as into a packed brick
+	const Entry& entry = directory[brick];
+	uint* line[BRICKDIM * BRICKDIM];
+	for (int z = 0; z < BRICKDIM; z++) for (int y = 0; y < BRICKDIM; y++)
+		line[y + z * BRICKDIM] = dest + y * strideY + z * strideZ;
+	if (entry.words == 0)
+	{
+		for (int i = 0; i < BRICKDIM * BRICKDIM; i++) for (int x = 0; x < BRICKDIM; x++) line[i][x] = entry.value;
+		return;
+	}
+	const uint* data = (const uint*)(base + entry.offset);
+	if (entry.words == BRICKSIZE)
+	{
+		for (int i = 0; i < BRICKDIM * BRICKDIM; i++) memcpy( line[i], data + i * BRICKDIM, BRICKDIM * sizeof( uint ) );
+		return;
+	}
+	for (uint i = 0, voxel = 0; i + 1 < entry.words; i += 2)
+	{
+		const uint value = data[i + 1];
+		for (uint end = min( voxel + data[i], (uint)BRICKSIZE ); voxel < end; voxel++)
+			line[voxel / BRICKDIM][voxel % BRICKDIM] = value;
+	}
+}
+
+void SceneFile::EncodeBrick( const uint* grid, const int brick, Entry& entry, vector<uint>& data )
+{
+	// gather the brick, then pick the smallest of the three representations
+	const int bx = (brick % GRIDBRICKS) * BRICKDIM, by = ((brick / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM, bz = (brick / GRIDBRICKS2) * BRICKDIM;
+	uint voxels[BRICKSIZE];
+	for (int z = 0; z < BRICKDIM; z++) for (int y = 0; y < BRICKDIM; y++)
+		memcpy( voxels + (y + z * BRICKDIM) * BRICKDIM, grid + bx + (by + y) * GRIDSIZE + (bz + z) * GRIDSIZE2, BRICKDIM * sizeof( uint ) );
+	data.clear();
+	for (int i = 0; i < BRICKSIZE;)
+	{
+		int run = 1;
+		while (i + run < BRICKSIZE && voxels[i + run] == voxels[i]) run++;
+		data.push_back( run );
+		data.push_back( voxels[i] );
+		i += run;
+	}
+	entry.value = voxels[0];
+	if (data.size() == 2) data.clear(); // uniform
+	else if (data.size() >= BRICKSIZE) data.assign( voxels, voxels + BRICKSIZE ); // raw
+	entry.words = (uint)data.size();
+}
+
+void SceneFile::Save( const char* file, const uint* grid )
+{
+	FILE* f = fopen( file, "wb" );
+	if (!f) FatalError( "Could not write %s", file );
+	Write( f, grid );
+	fclose( f );
+}
+
+void SceneFile::Write( FILE* f, const uint* grid )
+{
+	// write a scene image at the current position of f
+	vector<uchar> image;
+	Write( image, grid );
+	fwrite( image.data(), 1, image.size(), f );
+}
+
+void SceneFile::Write( vector<uchar>& image, const uint* grid )
+{
+	// build a scene image in memory: the bricks are encoded in parallel, then
+	// stored in order
+	vector<vector<uint>> data( BRICKCOUNT );
+	vector<Entry> directory( BRICKCOUNT );
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < BRICKCOUNT; i++) EncodeBrick( grid, i, directory[i], data[i] );
+	uint64_t offset = sizeof( Header ) + BRICKCOUNT * sizeof( Entry );
+	for (int i = 0; i < BRICKCOUNT; i++) directory[i].offset = offset, offset += directory[i].words * sizeof( uint );
+	Header header = {};
+	header.magic = SCENEFILE_MAGIC, header.version = SCENEFILE_VERSION;
+	header.gridSize = GRIDSIZE, header.brickDim = BRICKDIM, header.brickCount = BRICKCOUNT;
+	image.resize( offset );
+	memcpy( image.data(), &header, sizeof( Header ) );
+	memcpy( image.data() + sizeof( Header ), directory.data(), BRICKCOUNT * sizeof( Entry ) );
+	for (int i = 0; i < BRICKCOUNT; i++) if (directory[i].words) memcpy( image.data() + directory[i].offset, data[i].data(), directory[i].words * sizeof( uint ) );
+}
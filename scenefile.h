@@ -0,0 +1,64 @@
+#pragma once
+
+#define SCENEFILE_MAGIC		0x53584f56	// 'VOXS'
+#define SCENEFILE_VERSION	1
+
+namespace Tmpl8 {
+
+// MappedFile: read-only memory mapping of an entire file.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+	bool Open( const char* file );
+	void Close();
+	const uchar* data = 0;
+	size_t size = 0;
+};
+
+// SceneFile: native on-disk scene format, read through a memory mapping.
+// Layout: a header, a directory with one entry per brick, and the brick data.
+// Bricks are compressed independently, so they can be decoded in parallel or
+// on demand; the OS only pages in the parts of the file that are touched.
+// A brick is stored in one of three ways:
+// - uniform: no data, every voxel equals the directory entry's value;
+// - rle: (count, value) word pairs, voxels in x, y, z order within the brick;
+// - raw: BRICKSIZE words, used when rle would not be smaller.
+// A scene image can also be embedded in a larger file, see Attach; offsets in
+// the directory are relative to the image's header.
+class SceneFile
+{
+public:
+	struct Header
+	{
+		uint magic, version;
+		uint gridSize, brickDim;
+		uint brickCount, dummy[3];
+	};
+	struct Entry
+	{
+		uint64_t offset;	// of the brick data, in bytes from the header
+		uint words;			// size of the brick data; 0 for a uniform brick
+		uint value;			// voxel value of a uniform brick
+	};
+	SceneFile() = default;
+	~SceneFile() { Close(); }
+	bool Open( const char* file );
+	bool Attach( const uchar* image, const size_t bytes );
+	void Close();
+	void DecodeBrick( const int brick, uint* dest, const uint strideY, const uint strideZ ) const;
+	static void Save( const char* file, const uint* grid );
+	static void Write( FILE* f, const uint* grid );
+	static void Write( vector<uchar>& image, const uint* grid );
+	// data members
+	const Header* header = 0;
+	const Entry* directory = 0;
+	const uchar* base = 0;		// start of the scene image
+	size_t size = 0;			// size of the scene image, in bytes
+	MappedFile mapped;			// backing storage, if opened from a file
+private:
+	static void EncodeBrick( const uint* grid, const int brick, Entry& entry, vector<uint>& data );
+};
+
+} // namespace Tmpl8
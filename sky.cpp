@@ -0,0 +1,175 @@
+#include "template.h"
+
+// fast atan2 approximation (max error ~1e-5 rad), scalar and 8-wide.
+// Both paths use the same polynomial so packets and single rays agree.
+static inline float FastAtan2( const float y, const float x )
+{
+	const float ax = fabsf( x ), ay = fabsf( y );
+	const float a = min( ax, ay ) / max( max( ax, ay ), 1e-20f ), s = a * a;
+	float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a;
+	if (ay > ax) r = 0.5f * PI - r;
+	if (x < 0) r = PI - r;
+	return y < 0 ? -r : r;
+}
+static inline __m256 FastAtan2_8( const __m256 y, const __m256 x )
+{
+	const __m256 signMask = _mm256_set1_ps( -0.0f );
+	const __m256 ax = _mm256_andnot_ps( signMask, x ), ay = _mm256_andnot_ps( signMask, y );
+	const __m256 a = _mm256_div_ps( _mm256_min_ps( ax, ay ), _mm256_max_ps( _mm256_max_ps( ax, ay ), _mm256_set1_ps( 1e-20f ) ) );
+	const __m256 s = _mm256_mul_ps( a, a );
+	__m256 r = _mm256_fmadd_ps( _mm256_set1_ps( -0.01172120f ), s, _mm256_set1_ps( 0.05265332f ) );
+	r = _mm256_fmadd_ps( r, s, _mm256_set1_ps( -0.11643287f ) );
+	r = _mm256_fmadd_ps( r, s, _mm256_set1_ps( 0.19354346f ) );
+	r = _mm256_fmadd_ps( r, s, _mm256_set1_ps( -0.33262347f ) );
+	r = _mm256_mul_ps( _mm256_fmadd_ps( r, s, _mm256_set1_ps( 0.99997726f ) ), a );
+	r = _mm256_blendv_ps( r, _mm256_sub_ps( _mm256_set1_ps( 0.5f * PI ), r ), _mm256_cmp_ps( ay, ax, _CMP_GT_OQ ) );
+	r = _mm256_blendv_ps( r, _mm256_sub_ps( _mm256_set1_ps( PI ), r ), x );
+	return _mm256_xor_ps( r, _mm256_and_ps( y, signMask ) );
+}
+
+// binary search for the last cdf entry that does not exceed r
+static inline int FindInterval( const float* cdf, const int n, const float r )
+{
+	int lo = 0, hi = n;
+	while (hi - lo > 1)
+	{
+		const int mid = (lo + hi) >> 1;
+		if (cdf[mid] <= r) lo = mid; else hi = mid;
+	}
+	return lo;
+}
+
+Sky::~Sky()
+{
+	FREE64( texels );
+	FREE64( marginalCdf );
+	FREE64( conditionalCdf );
+}
+
+void Sky::Load( const char* file, const float scale )
+{
+	// load the image using the template surface class
+	Surface image;
+	image.LoadFromFile( file );
+	if (!image.pixels) FatalError( "File not found: %s", file );
+	FREE64( texels );
+	FREE64( marginalCdf );
+	FREE64( conditionalCdf );
+	width = image.width, height = image.height;
+	const int n = width * height;
+	texels = (float*)MALLOC64( 3 * n * sizeof( float ) );
+	marginalCdf = (float*)MALLOC64( (height + 1) * sizeof( float ) );
+	conditionalCdf = (float*)MALLOC64( height * (width + 1) * sizeof( float ) );
+	// convert to planar floats and build the conditional cdf for each row;
+	// texel weights are scaled by sin(theta) to account for lat-long stretching
+	float* rowWeight = new float[height];
+#pragma omp parallel for schedule(dynamic)
+	for (int y = 0; y < height; y++)
+	{
+		const float sinTheta = sinf( PI * (y + 0.5f) / height );
+		float* cdf = conditionalCdf + y * (width + 1);
+		cdf[0] = 0;
+		for (int x = 0; x < width; x++)
+		{
+			const int i = x + y * width;
+			const float3 c = RGB8_to_RGBF32( image.pixels[i] ) * scale;
+			texels[i] = c.x, texels[i + n] = c.y, texels[i + 2 * n] = c.z;
+			cdf[x + 1] = cdf[x] + (0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z) * sinTheta;
+		}
+		rowWeight[y] = cdf[width];
+		if (rowWeight[y] > 0) for (int x = 1; x < width; x++) cdf[x] /= rowWeight[y];
+		else for (int x = 1; x < width; x++) cdf[x] = (float)x / width;
+		cdf[width] = 1;
+	}
+	// marginal cdf over the rows
+	marginalCdf[0] = 0;
+	for (int y = 0; y < height; y++) marginalCdf[y + 1] = marginalCdf[y] + rowWeight[y];
+	const float total = marginalCdf[height];
+	if (total > 0) for (int y = 1; y < height; y++) marginalCdf[y] /= total;
+	else for (int y = 1; y < height; y++) marginalCdf[y] = (float)y / height;
+	marginalCdf[height] = 1;
+	delete[] rowWeight;
+	// mean radiance, weighted by solid angle, for cheap ambient estimates
+	float3 sum( 0 );
+	float weight = 0;
+	for (int y = 0; y < height; y++)
+	{
+		const float sinTheta = sinf( PI * (y + 0.5f) / height );
+		for (int x = 0; x < width; x++)
+		{
+			const int i = x + y * width;
+			sum += sinTheta * float3( texels[i], texels[i + n], texels[i + 2 * n] );
+		}
+		weight += sinTheta * width;
+	}
+	average = sum * (1 / weight);
+}
+
+int Sky::TexelIndex( const float3& D ) const
+{
+	// lat-long mapping: u from azimuth around y, v from polar angle (0 = up)
+	const float u = FastAtan2( D.x, -D.z ) * INV2PI + 0.5f;
+	const float v = FastAtan2( sqrtf( D.x * D.x + D.z * D.z ), D.y ) * INVPI;
+	const int x = clamp( (int)(u * width), 0, width - 1 );
+	const int y = clamp( (int)(v * height), 0, height - 1 );
+	return x + y * width;
+}
+
+float3 Sky::Lookup( const float3& D ) const
+{
+	if (!texels) return float3( 0 );
+	const int i = TexelIndex( D ), n = width * height;
+	return float3( texels[i], texels[i + n], texels[i + 2 * n] );
+}
+
+void Sky::Lookup8( const __m256 Dx, const __m256 Dy, const __m256 Dz, __m256& r, __m256& g, __m256& b ) const
+{
+	if (!texels) { r = g = b = _mm256_setzero_ps(); return; }
+	// same mapping as TexelIndex, for 8 directions at once
+	const __m256 negDz = _mm256_xor_ps( Dz, _mm256_set1_ps( -0.0f ) );
+	const __m256 horiz = _mm256_sqrt_ps( _mm256_fmadd_ps( Dx, Dx, _mm256_mul_ps( Dz, Dz ) ) );
+	const __m256 u = _mm256_fmadd_ps( FastAtan2_8( Dx, negDz ), _mm256_set1_ps( INV2PI ), _mm256_set1_ps( 0.5f ) );
+	const __m256 v = _mm256_mul_ps( FastAtan2_8( horiz, Dy ), _mm256_set1_ps( INVPI ) );
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i x = _mm256_max_epi32( zero, _mm256_min_epi32( _mm256_set1_epi32( width - 1 ),
+		_mm256_cvttps_epi32( _mm256_mul_ps( u, _mm256_set1_ps( (float)width ) ) ) ) );
+	const __m256i y = _mm256_max_epi32( zero, _mm256_min_epi32( _mm256_set1_epi32( height - 1 ),
+		_mm256_cvttps_epi32( _mm256_mul_ps( v, _mm256_set1_ps( (float)height ) ) ) ) );
+	const __m256i i = _mm256_add_epi32( x, _mm256_mullo_epi32( y, _mm256_set1_epi32( width ) ) );
+	const int n = width * height;
+	r = _mm256_i32gather_ps( texels, i, 4 );
+	g = _mm256_i32gather_ps( texels + n, i, 4 );
+	b = _mm256_i32gather_ps( texels + 2 * n, i, 4 );
+}
+
+float3 Sky::Sample( const float r0, const float r1, float3& D, float& pdf ) const
+{
+	pdf = 0;
+	if (!texels) return float3( 0 );
+	// pick a row using the marginal cdf, then a column in that row
+	const int y = FindInterval( marginalCdf, height, r0 );
+	const float* cdf = conditionalCdf + y * (width + 1);
+	const int x = FindInterval( cdf, width, r1 );
+	const float rowPdf = marginalCdf[y + 1] - marginalCdf[y], colPdf = cdf[x + 1] - cdf[x];
+	// reuse the remaining precision of r0, r1 to jitter within the texel
+	const float u = (x + (r1 - cdf[x]) / colPdf) / width;
+	const float v = (y + (r0 - marginalCdf[y]) / rowPdf) / height;
+	const float theta = v * PI, phi = (u - 0.5f) * TWOPI, sinTheta = sinf( theta );
+	D = float3( sinTheta * sinf( phi ), cosf( theta ), -sinTheta * cosf( phi ) );
+	if (sinTheta <= 0) return float3( 0 );
+	// convert the pdf from image space to solid angle
+	pdf = (rowPdf * height) * (colPdf * width) / (2 * PI * PI * sinTheta);
+	const int i = x + y * width, n = width * height;
+	return float3( texels[i], texels[i + n], texels[i + 2 * n] );
+}
+
+float Sky::Pdf( const float3& D ) const
+{
+	if (!texels) return 0;
+	const float sinTheta = sqrtf( max( 0.0f, 1 - D.y * D.y ) );
+	if (sinTheta <= 0) return 0;
+	const int i = TexelIndex( D ), x = i % width, y = i / width;
+	const float* cdf = conditionalCdf + y * (width + 1);
+	const float rowPdf = marginalCdf[y + 1] - marginalCdf[y], colPdf = cdf[x + 1] - cdf[x];
+	return (rowPdf * height) * (colPdf * width) / (2 * PI * PI * sinTheta);
+}
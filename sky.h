@@ -0,0 +1,30 @@
+#pragma once
+
+namespace Tmpl8 {
+
+// Sky: lat-long environment map, used for rays that leave the scene.
+// Texels are stored as planar floats (all red, then all green, then all blue)
+// so that the 8-wide lookup can fetch each channel with a single AVX2 gather.
+// A 2D CDF (marginal over rows, conditional per row) is precomputed for
+// importance sampling of sky light.
+class Sky
+{
+public:
+	Sky() = default;
+	~Sky();
+	void Load( const char* file, const float scale = 1.0f );
+	float3 Lookup( const float3& D ) const;
+	void Lookup8( const __m256 Dx, const __m256 Dy, const __m256 Dz, __m256& r, __m256& g, __m256& b ) const;
+	float3 Sample( const float r0, const float r1, float3& D, float& pdf ) const;
+	float Pdf( const float3& D ) const;
+	// data members
+	int width = 0, height = 0;
+	float3 average = float3( 0 );	// mean radiance over the sphere
+	float* texels = 0;			// planar rgb, 3 * width * height floats
+	float* marginalCdf = 0;		// height + 1 entries
+	float* conditionalCdf = 0;	// height rows of width + 1 entries
+private:
+	int TexelIndex( const float3& D ) const;
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,109 @@
+#include "template.h"
+
+#ifdef _MSC_VER
+#define ftell64 _ftelli64
+#define fseek64 _fseeki64
+#else
+#define ftell64 ftello
+#define fseek64 fseeko
+#endif
+
+bool Snapshot::Create( const char* fileName )
+{
+	// the sections go to a temporary file, which Commit puts in place
+	Close();
+	target = fileName;
+	file = fopen( (target + ".tmp").c_str(), "wb" );
+	if (!file) return false;
+	const Header header = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION };
+	Write( header );
+	return true;
+}
+
+void Snapshot::BeginSection( const uint tag, const uint version )
+{
+	// write the section header; its size is filled in by EndSection
+	sectionStart = ftell64( file );
+	const Section header = { tag, version, 0 };
+	Write( header );
+}
+
+void Snapshot::Write( const void* data, const size_t bytes )
+{
+	fwrite( data, 1, bytes, file );
+}
+
+void Snapshot::EndSection()
+{
+	// pad to 8 bytes, so that every section starts aligned
+	const int64_t end = ftell64( file );
+	const uint64_t size = end - sectionStart - sizeof( Section ), zero = 0;
+	Write( &zero, (8 - (size & 7)) & 7 );
+	fseek64( file, sectionStart + offsetof( Section, size ), SEEK_SET );
+	Write( size );
+	fseek64( file, 0, SEEK_END );
+}
+
+bool Snapshot::Open( const char* fileName )
+{
+	Close();
+	if (!mapped.Open( fileName )) return false;
+	const Header* header = (const Header*)mapped.data;
+	if (mapped.size >= sizeof( Header ) && header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION) return true;
+	Close();
+	return false;
+}
+
+bool Snapshot::FindSection( const uint tag, uint& version )
+{
+	// walk the section headers; on success, Read continues from the start of the section
+	section = 0, sectionSize = cursor = 0;
+	for (uint64_t pos = sizeof( Header ); pos + sizeof( Section ) <= mapped.size;)
+	{
+		const Section* s = (const Section*)(mapped.data + pos);
+		pos += sizeof( Section );
+		if (s->size > mapped.size - pos) return false; // truncated file
+		if (s->tag == tag)
+		{
+			section = mapped.data + pos, sectionSize = s->size, version = s->version;
+			return true;
+		}
+		pos += (s->size + 7) & ~7ull;
+	}
+	return false;
+}
+
+bool Snapshot::Read( void* data, const size_t bytes )
+{
+	// reading past the end of a section leaves 'data' untouched
+	if (!section || cursor + bytes > sectionSize) return false;
+	memcpy( data, section + cursor, bytes );
+	cursor += bytes;
+	return true;
+}
+
+bool Snapshot::Commit()
+{
+	// replace the target file in one step, so that a crash leaves either the
+	// old snapshot or the new one; false if the new one could not be written
+	if (!file) return false;
+	const string temp = target + ".tmp";
+	bool written = !ferror( file );
+	written = fclose( file ) == 0 && written;
+	file = 0;
+#ifdef _WIN32
+	if (written) written = MoveFileExA( temp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+	if (written) written = rename( temp.c_str(), target.c_str() ) == 0;
+#endif
+	if (!written) remove( temp.c_str() );
+	return written;
+}
+
+void Snapshot::Close()
+{
+	// a snapshot that was created but not committed is discarded
+	if (file) fclose( file ), remove( (target + ".tmp").c_str() );
+	mapped.Close();
+	file = 0, section = 0, sectionSize = cursor = 0;
+}
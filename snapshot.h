@@ -0,0 +1,58 @@
+#pragma once
+
+#define SNAPSHOT_MAGIC		0x54535856	// 'VXST'
+#define SNAPSHOT_VERSION	1
+
+// section tags
+#define SECTION_CAMERA		0x524d4143	// 'CAMR'
+#define SECTION_RENDERER	0x444e4552	// 'REND'
+#define SECTION_VOXELS		0x4c584f56	// 'VOXL'
+
+namespace Tmpl8 {
+
+// Snapshot: versioned application state file.
+// The file is a header followed by tagged sections, each with its own version
+// and size, so readers skip sections they do not know, and fields that were
+// added to a section later keep their defaults when an older file is read.
+// Sections are written field by field, to a temporary file; Commit then
+// replaces the file in one step, so an existing snapshot is never left half
+// written. Reading maps the file, so a section with voxel data can be decoded
+// in place, see SceneFile::Attach.
+class Snapshot
+{
+public:
+	struct Header
+	{
+		uint magic, version;
+	};
+	struct Section
+	{
+		uint tag, version;
+		uint64_t size;			// in bytes, excluding this struct
+	};
+	Snapshot() = default;
+	~Snapshot() { Close(); }
+	// writing
+	bool Create( const char* fileName );
+	void BeginSection( const uint tag, const uint version );
+	void Write( const void* data, const size_t bytes );
+	template <class T> void Write( const T& value ) { Write( &value, sizeof( T ) ); }
+	void EndSection();
+	bool Commit();
+	// reading
+	bool Open( const char* fileName );
+	bool FindSection( const uint tag, uint& version );
+	bool Read( void* data, const size_t bytes );
+	template <class T> bool Read( T& value ) { return Read( &value, sizeof( T ) ); }
+	void Close();
+	// data members
+	FILE* file = 0;				// when writing
+	MappedFile mapped;			// when reading
+	const uchar* section = 0;	// data of the section found by FindSection
+	uint64_t sectionSize = 0, cursor = 0;
+private:
+	string target;				// when writing; Commit renames the temporary file to it
+	int64_t sectionStart = 0;
+};
+
+} // namespace Tmpl8
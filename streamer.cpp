@@ -0,0 +1,152 @@
+#include "template.h"
+
+AssetStreamer::AssetStreamer()
+{
+	worker = thread( &AssetStreamer::Worker, this );
+}
+
+AssetStreamer::~AssetStreamer()
+{
+	{
+		lock_guard<mutex> guard( lock );
+		quit = true;
+	}
+	wake.notify_one();
+	worker.join();
+	for (Brick* brick : ready) delete brick;
+	for (size_t i = published; i < publishing.size(); i++) delete publishing[i];
+}
+
+void AssetStreamer::LoadModel( const char* file, const int3 offset, const int rotation )
+{
+	// queue a .bin model; see ModelReader for offset and rotation
+	{
+		lock_guard<mutex> guard( lock );
+		jobs.push_back( Job{ file, offset, rotation, false } );
+	}
+	queueDepth++;
+	wake.notify_one();
+}
+
+void AssetStreamer::LoadScene( const char* file )
+{
+	// queue a scene saved with Scene::Save; it replaces the entire world
+	{
+		lock_guard<mutex> guard( lock );
+		jobs.push_back( Job{ file, make_int3( 0 ), 0, true } );
+	}
+	queueDepth++;
+	wake.notify_one();
+}
+
+void AssetStreamer::Worker()
+{
+	while (1)
+	{
+		Job job;
+		{
+			unique_lock<mutex> guard( lock );
+			wake.wait( guard, [this] { return quit || !jobs.empty(); } );
+			if (quit) return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		progress = 0;
+		if (job.scene) StreamScene( job ); else StreamModel( job );
+		progress = 1;
+		queueDepth--;
+	}
+}
+
+void AssetStreamer::Hand( vector<Brick*>& batch )
+{
+	// make prepared bricks available to Publish; throttle if it falls behind
+	while (pending > maxPending && !quit) this_thread::sleep_for( chrono::milliseconds( 1 ) );
+	pending += (int)batch.size();
+	{
+		lock_guard<mutex> guard( lock );
+		ready.insert( ready.end(), batch.begin(), batch.end() );
+	}
+	batch.clear();
+}
+
+void AssetStreamer::StreamModel( const Job& job )
+{
+	// a brick may receive voxels until the end of the file, so the model is
+	// handed over once it has been read completely
+	ModelReader model;
+	if (!model.Open( job.file.c_str(), job.offset, job.rotation )) { failed++; return; }
+	unordered_map<int, Brick*> bricks;
+	uint x, y, z, v, voxels = 0;
+	while (model.Next( x, y, z, v ))
+	{
+		Brick*& brick = bricks[Scene::BrickIndex( x, y, z )];
+		if (!brick)
+		{
+			brick = new Brick;
+			brick->index = Scene::BrickIndex( x, y, z );
+			memset( brick->mask, 0, sizeof( brick->mask ) );
+		}
+		const uint line = (y % BRICKDIM) + (z % BRICKDIM) * BRICKDIM;
+		brick->voxel[(x % BRICKDIM) + line * BRICKDIM] = v;
+		brick->mask[line] |= 1 << (x % BRICKDIM);
+		if ((++voxels & 4095) == 0) progress = model.Progress();
+		if (quit) break;
+	}
+	if (model.truncated) failed++;
+	vector<Brick*> batch;
+	for (auto& brick : bricks) batch.push_back( brick.second );
+	Hand( batch );
+}
+
+void AssetStreamer::StreamScene( const Job& job )
+{
+	// scene bricks are complete when decoded, so they are handed over in batches
+	SceneFile source;
+	if (!source.Open( job.file.c_str() ) || source.header->gridSize != GRIDSIZE || source.header->brickCount != BRICKCOUNT)
+	{
+		failed++;
+		return;
+	}
+	vector<Brick*> batch;
+	for (int i = 0; i < BRICKCOUNT && !quit; i++)
+	{
+		Brick* brick = new Brick;
+		brick->index = i;
+		memset( brick->mask, 255, sizeof( brick->mask ) );
+		source.DecodeBrick( i, brick->voxel, BRICKDIM, BRICKDIM * BRICKDIM );
+		batch.push_back( brick );
+		if (batch.size() == 256) Hand( batch ), progress = (float)i / BRICKCOUNT;
+	}
+	Hand( batch );
+}
+
+void AssetStreamer::Publish( Scene& scene )
+{
+	// called by the main thread between frames, when nothing reads the grid
+	if (published == publishing.size())
+	{
+		publishing.clear(), published = 0;
+		lock_guard<mutex> guard( lock );
+		publishing.swap( ready );
+	}
+	const size_t last = min( publishing.size(), published + bricksPerFrame );
+	for (; published < last; published++)
+	{
+		const Brick* brick = publishing[published];
+		const int b = brick->index;
+		uint* dest = scene.grid + (b % GRIDBRICKS) * BRICKDIM + ((b / GRIDBRICKS) % GRIDBRICKS) * BRICKDIM * GRIDSIZE + (b / GRIDBRICKS2) * BRICKDIM * GRIDSIZE2;
+		for (int i = 0; i < BRICKDIM * BRICKDIM; i++)
+		{
+			const uint mask = brick->mask[i];
+			if (!mask) continue;
+			uint* line = dest + (i % BRICKDIM) * GRIDSIZE + (i / BRICKDIM) * GRIDSIZE2;
+			const uint* src = brick->voxel + i * BRICKDIM;
+			if (mask == 255) memcpy( line, src, BRICKDIM * sizeof( uint ) );
+			else for (int x = 0; x < BRICKDIM; x++) if (mask & (1 << x)) line[x] = src[x];
+		}
+		scene.MarkDirty( b );
+		delete brick;
+		pending--;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+namespace Tmpl8 {
+
+// AssetStreamer: loads models and scenes on a background thread.
+// The loader decodes into prepared bricks, which the renderer does not see.
+// Finished bricks are handed over in batches. Publish runs between frames:
+// it swaps the list of handed-over bricks out under a lock, then copies at
+// most 'bricksPerFrame' bricks into the scene grid per call. This way a large
+// model streams in over several frames instead of stalling one of them.
+class AssetStreamer
+{
+public:
+	struct Brick
+	{
+		int index;					// brick index in the scene
+		uchar mask[BRICKDIM * BRICKDIM];	// per line of 8 voxels: bits for the voxels to write
+		uint voxel[BRICKSIZE];		// x, y, z order
+	};
+	AssetStreamer();
+	~AssetStreamer();
+	void LoadModel( const char* file, const int3 offset, const int rotation = 0 );
+	void LoadScene( const char* file );
+	void Publish( Scene& scene );
+	// status, for display
+	int QueueDepth() const { return queueDepth; }
+	int Pending() const { return pending; }
+	float Progress() const { return progress; }
+	int Failed() const { return failed; }
+	// settings
+	int bricksPerFrame = 256;		// publish budget
+	int maxPending = 16384;			// the loader waits when this many bricks are unpublished
+private:
+	struct Job
+	{
+		string file;
+		int3 offset;
+		int rotation;
+		bool scene;					// native scene file instead of a .bin model
+	};
+	void Worker();
+	void StreamModel( const Job& job );
+	void StreamScene( const Job& job );
+	void Hand( vector<Brick*>& batch );
+	thread worker;
+	mutex lock;						// guards jobs and ready
+	condition_variable wake;
+	list<Job> jobs;
+	vector<Brick*> ready;			// handed over by the loader
+	vector<Brick*> publishing;		// owned by the main thread
+	size_t published = 0;			// bricks of 'publishing' that were copied to the scene
+	atomic<int> queueDepth = 0;		// jobs queued or in progress
+	atomic<int> pending = 0;		// prepared bricks that have not been published
+	atomic<int> failed = 0;			// jobs that could not be loaded
+	atomic<float> progress = 1;		// of the current job
+	atomic<bool> quit = false;
+};
+
+} // namespace Tmpl8
@@ -91,6 +91,12 @@ void main()
 	/* in case you need this in Linux, this is the non-windows way:
 	#include <fenv.h>
 	fesetenv(FE_DFL_DISABLE_SSE_DENORMS_ENV); */
+	// command line tool: convert a .bin model to a block model, see BlockModel
+	if (__argc == 4 && strcmp( __argv[1], "-convert" ) == 0)
+	{
+		if (!BlockModel::Convert( __argv[2], __argv[3] )) FatalError( "Could not convert %s", __argv[2] );
+		return;
+	}
 	// open a window
 	if (!glfwInit()) FatalError( "glfwInit failed." );
 	glfwSetErrorCallback( ErrorCallback );
@@ -149,30 +155,8 @@ void main()
 	InitRenderTarget( SCRWIDTH, SCRHEIGHT );
 	Surface* screen = new Surface( SCRWIDTH, SCRHEIGHT );
 	app = new Renderer();
-#if 0
-	// deserizalize
-	FILE* f = fopen( "appstate.dat", "rb" );
-	if (f)
-	{
-		uint version, appSize;
-		fread( &version, 1, 4, f );
-		fread( &appSize, 1, 4, f );
-		// we check file format version and sizeof( Renderer ) so we don't accidentally read
-		// an app state that is invalid.
-		uint base_size = (uint)(((uchar*)&app->end_of_base_class + 4) - (uchar*)app);
-		uint rendererSize = sizeof( Renderer ) - base_size;
-		if (version == 0x10001006 && appSize == rendererSize)
-		{
-			// we only overwrite the data unique to the derived Renderer class -
-			// disturbing other data is not consistent between debug and release.
-			void* target = ((uchar*)app + sizeof( Renderer )) - rendererSize;
-			fread( target, 1, rendererSize, f );
-		}
-		fclose( f );
-	}
-	// reconstruct scene, so we can change it and still de-serialize
-	((Renderer*)app)->scene = Scene();
-#endif
+	// resume from the previous session, or start with a fresh world
+	if (!((Renderer*)app)->RestoreState( "appstate.dat" )) ((Renderer*)app)->scene.Generate();
 	// finalize app
 	app->screen = screen;
 	app->Init();
@@ -346,18 +330,8 @@ void main()
 		}
 		if (!running) break;
 	}
-#if 0
-	// serialize
-	f = fopen( "appstate.dat", "wb" );
-	uint base_size = (uint)(((uchar*)&app->end_of_base_class + 4) - (uchar*)app);
-	uint rendererSize = sizeof( Renderer ) - base_size;
-	uint version = 0x10001006;
-	fwrite( &version, 1, 4, f );
-	fwrite( &rendererSize, 1, 4, f );
-	void* source = ((uchar*)app + sizeof( Renderer )) - rendererSize;
-	fwrite( source, 1, rendererSize, f );
-	fclose( f );
-#endif
+	// save the application state, see Renderer::RestoreState
+	((Renderer*)app)->SaveState( "appstate.dat" );
 	// close down
 	app->Shutdown();
 	delete app;
@@ -5,6 +5,13 @@
 #include <chrono>
 #include <fstream>
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
 #include <list>
 #include <string>
 #include <math.h>
@@ -322,8 +329,26 @@ public:
 };
 
 #include "ray.h"
+#include "scenefile.h"
+#include "blockmodel.h"
+#include "snapshot.h"
+#include "instances.h"
 #include "scene.h"
+#include "edits.h"
+#include "journal.h"
+#include "replication.h"
+#include "streamer.h"
+#include "sky.h"
+#include "mipvolume.h"
+#include "lighttree.h"
+#include "physics.h"
+#include "automaton.h"
+#include "islands.h"
 #include "camera.h"
+#include "brickstore.h"
+#include "animation.h"
+#include "pager.h"
+#include "denoiser.h"
 #include "renderer.h"
 
 // EOF
\ No newline at end of file